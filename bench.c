@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+
+#include "gameplay.h"
+#include "lobby.h"
+#include "scan.h"
+
+/* wordbench times the parts of the game engine on their own, with no
+ * sockets and no logging:
+ *    - picking a word from the dictionary (init_game)
+ *    - handling a guess and sending the update for it (lobby_apply)
+ *    - rendering the status (status_message)
+ *    - splitting a buffer of pipelined lines, at each scanning level
+ */
+
+#define SELECT_OPS 200
+#define GUESS_OPS 1000000
+#define STATUS_OPS 1000000
+#define BENCH_PLAYERS 4
+#define SMALL_DICT 64           // Words in the dictionary used for guessing
+#define SCAN_OPS 20000
+#define SCAN_BUF 4096           // Bytes of pipelined input per scan
+
+void report(char *name, long elapsed, long ops) {
+    printf("%-18s %10.1f ns/op  (%ld ops)\n", name, (double)elapsed / ops, ops);
+}
+
+// The lobby is too big for the stack, so the benchmarks share this one
+static struct lobby lobby;
+
+// Time picking words from the whole dictionary
+void bench_select(char *dict_name) {
+    lobby_init(&lobby, dict_name);
+    struct room *room = room_create(&lobby);
+
+    long start = now_ns();
+    for (int i = 0; i < SELECT_OPS; i++) {
+        init_game(&(room->game), dict_name);
+    }
+    report("word selection", now_ns() - start, SELECT_OPS);
+    lobby_free(&lobby);
+}
+
+/* Write the first SMALL_DICT words of dict_name to a temporary file, so
+ * that the rounds started while guessing don't spend their time reading
+ * the dictionary. Return the name of the file in buf.
+ */
+char *small_dictionary(char *dict_name, char *buf) {
+    char word[MAX_MSG];
+    strcpy(buf, "/tmp/wordbench-XXXXXX");
+    int fd = mkstemp(buf);
+    FILE *in = fopen(dict_name, "r");
+    FILE *out = fdopen(fd, "w");
+    if (fd < 0 || in == NULL || out == NULL) {
+        perror("small dictionary");
+        exit(1);
+    }
+    for (int i = 0; i < SMALL_DICT && fgets(word, MAX_MSG, in) != NULL; i++) {
+        fputs(word, out);
+    }
+    fclose(in);
+    fclose(out);
+    return buf;
+}
+
+// Time guesses from a room of BENCH_PLAYERS players, one update per guess
+void bench_guess(char *dict_name) {
+    struct output_list out;
+    struct game_event ev;
+    char line[MAX_BUF];
+    long bytes = 0;
+
+    // The players fill one room and are seated at the first tick
+    lobby_init(&lobby, dict_name);
+    lobby.room_size = BENCH_PLAYERS;
+    output_init(&out);
+    memset(&ev, 0, sizeof(ev));
+    for (int fd = 0; fd < BENCH_PLAYERS; fd++) {
+        ev.type = EV_JOIN;
+        ev.fd = fd;
+        lobby_apply(&lobby, &ev, &out);
+        sprintf(line, "player%d", fd);
+        ev.type = EV_LINE;
+        ev.text = line;
+        lobby_apply(&lobby, &ev, &out);
+    }
+    ev.type = EV_TICK;
+    lobby_apply(&lobby, &ev, &out);
+    output_reset(&out);
+    struct game_state *game = &(lobby.rooms->game);
+
+    long start = now_ns();
+    for (int i = 0; i < GUESS_OPS; i++) {
+        int letter = 0;
+        while (game->letters_guessed[letter]) {
+            letter++;
+        }
+        line[0] = 'a' + letter;
+        line[1] = '\0';
+        ev.type = EV_LINE;
+        ev.fd = game->has_next_turn->fd;
+        ev.text = line;
+        lobby_apply(&lobby, &ev, &out);
+        ev.type = EV_TICK;
+        lobby_apply(&lobby, &ev, &out);
+        bytes += out.text_len;
+        output_reset(&out);
+    }
+    long elapsed = now_ns() - start;
+    report("guess and update", elapsed, GUESS_OPS);
+    printf("%-18s %10.0f guesses/sec, %.0f bytes sent per guess\n", "",
+        GUESS_OPS * 1e9 / elapsed, (double)bytes / GUESS_OPS);
+    output_free(&out);
+    lobby_free(&lobby);
+}
+
+// Time rendering the status of a game part way through
+void bench_status(char *dict_name) {
+    char msg[MAX_STATUS];
+    lobby_init(&lobby, dict_name);
+    struct room *room = room_create(&lobby);
+    room->game.letters_guessed[0] = 1;
+    room->game.letters_guessed[4] = 1;
+    room->game.letters_guessed[18] = 1;
+
+    long start = now_ns();
+    for (int i = 0; i < STATUS_OPS; i++) {
+        status_message(msg, &(room->game));
+    }
+    report("status rendering", now_ns() - start, STATUS_OPS);
+    lobby_free(&lobby);
+}
+
+/* Time finding the lines in a buffer of pipelined input, lower casing it
+ * and checking its letters, at each level of scanning the CPU supports.
+ */
+void bench_scan(void) {
+    char *names[] = {"scalar", "sse2", "avx2"};
+    char input[SCAN_BUF];
+    char work[SCAN_BUF];
+    char name[MAX_MSG];
+    int lines = 0;
+    int levels = 0;
+
+    // Lines as a busy client might send them: some names, some guesses
+    for (int i = 0; i < SCAN_BUF; i++) {
+        input[i] = "Player Name\r\nq\r\nanother_player\r\nE\r\n"[i % 37];
+    }
+    for (int level = SCAN_SCALAR; level <= SCAN_AVX2; level++) {
+        if (scan_use(level) != level) {
+            continue;
+        }
+        long start = now_ns();
+        for (int i = 0; i < SCAN_OPS; i++) {
+            int pos = 0, where;
+            memcpy(work, input, SCAN_BUF);
+            scan_lower(work, SCAN_BUF);
+            while ((where = scan_newline(work + pos, SCAN_BUF - pos)) >= 0) {
+                scan_letters(work + pos, where);
+                pos += where + 1;
+                lines++;
+            }
+        }
+        levels++;
+        sprintf(name, "scan (%s)", names[level]);
+        report(name, now_ns() - start, SCAN_OPS);
+    }
+    printf("%-18s %10.1f lines per %d byte buffer\n", "", (double)lines / SCAN_OPS / levels, SCAN_BUF);
+    scan_use(SCAN_DEFAULT);
+}
+
+int main(int argc, char **argv) {
+    char small[MAX_MSG];
+    char *dict_name = (argc > 1) ? argv[1] : "dictionary.txt";
+
+    game_verbose = 0;
+    srandom(1);
+    bench_select(dict_name);
+    bench_guess(small_dictionary(dict_name, small));
+    unlink(small);
+    bench_status(dict_name);
+    bench_scan();
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stddef.h>
+#include <sys/select.h>
+
+#include "config.h"
+#include "gameplay.h"
+#include "lobby.h"
+#include "scan.h"
+
+// A setting that is a whole number, and the values it may take
+struct setting {
+    const char *key;
+    size_t offset;
+    int min;
+    int max;
+};
+
+static const struct setting settings[] = {
+    {"port", offsetof(struct config, port), 1, 65535},
+    {"backlog", offsetof(struct config, backlog), 1, 65535},
+    {"max_clients", offsetof(struct config, max_clients), 1, MAX_CLIENTS},
+    {"buf_size", offsetof(struct config, buf_size), 16, MAX_LINE},
+    {"max_guesses", offsetof(struct config, max_guesses), 1, NUM_LETTERS},
+    {"room_size", offsetof(struct config, room_size), 1, 1000},
+    {"max_wait_ms", offsetof(struct config, max_wait_ms), 0, 3600000},
+    {"name_timeout_ms", offsetof(struct config, name_timeout_ms), 0, 86400000},
+    {"idle_timeout_ms", offsetof(struct config, idle_timeout_ms), 0, 86400000},
+};
+
+#define NUM_SETTINGS (sizeof(settings) / sizeof(settings[0]))
+
+static const char *scan_names[] = {"scalar", "sse2", "avx2"};
+
+void config_init(struct config *cfg) {
+    cfg->port = PORT;
+    cfg->backlog = MAX_QUEUE;
+    // Leave room below FD_SETSIZE for the listening socket and the journal
+    cfg->max_clients = MAX_CLIENTS - 8;
+    cfg->buf_size = MAX_BUF;
+    cfg->max_guesses = MAX_GUESSES;
+    cfg->room_size = ROOM_SIZE;
+    cfg->max_wait_ms = MAX_WAIT_MS;
+    cfg->name_timeout_ms = NAME_TIMEOUT_MS;
+    cfg->idle_timeout_ms = 0;
+    cfg->scan = SCAN_DEFAULT;
+}
+
+/* Set key to value. Return 0 on success, or print why not and
+ * return -1.
+ */
+int config_set(struct config *cfg, const char *key, const char *value) {
+    char *end;
+
+    if (strcmp(key, "scan") == 0) {
+        for (int level = SCAN_SCALAR; level <= SCAN_AVX2; level++) {
+            if (strcmp(value, scan_names[level]) == 0) {
+                cfg->scan = level;
+                return 0;
+            }
+        }
+        fprintf(stderr, "scan must be scalar, sse2 or avx2, not %s\n", value);
+        return -1;
+    }
+    for (int i = 0; i < NUM_SETTINGS; i++) {
+        const struct setting *s = &settings[i];
+        if (strcmp(key, s->key) != 0) {
+            continue;
+        }
+        long n = strtol(value, &end, 10);
+        if (*value == '\0' || *end != '\0' || n < s->min || n > s->max) {
+            fprintf(stderr, "%s must be a number from %d to %d, not %s\n",
+                key, s->min, s->max, value);
+            return -1;
+        }
+        *(int *)((char *)cfg + s->offset) = n;
+        return 0;
+    }
+    fprintf(stderr, "Unknown setting %s\n", key);
+    return -1;
+}
+
+// Return s without the white space at either end (s is changed)
+static char *trim(char *s) {
+    while (isspace((unsigned char)*s)) {
+        s++;
+    }
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1])) {
+        end--;
+    }
+    *end = '\0';
+    return s;
+}
+
+/* Set a value from "key=value" (option is changed). Return 0 on success,
+ * or print why not and return -1.
+ */
+int config_option(struct config *cfg, char *option) {
+    char *equals = strchr(option, '=');
+    if (equals == NULL) {
+        fprintf(stderr, "Expected key=value, not %s\n", option);
+        return -1;
+    }
+    *equals = '\0';
+    return config_set(cfg, trim(option), trim(equals + 1));
+}
+
+/* Read the settings in a config file.
+ * Terminate with exit code 1 if it can't be read or has a bad line.
+ */
+void config_file(struct config *cfg, const char *filename) {
+    char line[MAX_MSG];
+    int line_no = 0;
+    FILE *fp = fopen(filename, "r");
+    if (fp == NULL) {
+        perror("Opening config file");
+        exit(1);
+    }
+    while (fgets(line, MAX_MSG, fp) != NULL) {
+        line_no++;
+        char *comment = strchr(line, '#');
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+        char *setting = trim(line);
+        if (*setting == '\0') {
+            continue;
+        }
+        if (config_option(cfg, setting) != 0) {
+            fprintf(stderr, "%s:%d: bad setting\n", filename, line_no);
+            exit(1);
+        }
+    }
+    fclose(fp);
+}
+
+// Print the settings in the form a config file takes
+void config_print(struct config *cfg, FILE *fp) {
+    for (int i = 0; i < NUM_SETTINGS; i++) {
+        fprintf(fp, "%s = %d\n", settings[i].key,
+            *(int *)((char *)cfg + settings[i].offset));
+    }
+    fprintf(fp, "scan = %s\n", scan_names[cfg->scan]);
+}
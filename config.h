@@ -0,0 +1,37 @@
+#ifndef _CONFIG_H_
+#define _CONFIG_H_
+
+#include <stdio.h>
+
+#ifndef PORT
+    #define PORT 53744
+#endif
+#define MAX_QUEUE 5             // Default backlog of connections waiting for accept
+#define NAME_TIMEOUT_MS 60000   // Default time a new client has to send a name
+#define SWEEP_MS 1000           // How often connections are checked for timeouts
+
+/* Settings for one run of the server. They start out with the defaults
+ * that were built in, then a config file (-c) and the command line (-p,
+ * -o key=value) can change them, in the order they are given. A config
+ * file has one "key = value" per line; '#' starts a comment.
+ */
+struct config {
+    int port;
+    int backlog;        // Connections the kernel queues for accept
+    int max_clients;    // Connections open at once; more are refused
+    int buf_size;       // Input buffer per client: the longest line plus its newline
+    int max_guesses;    // Wrong guesses allowed in a round
+    int room_size;      // Players seated in a room
+    int max_wait_ms;    // Longest wait for a seat before a smaller room starts
+    int name_timeout_ms;    // Time to send a name after connecting (0 for no limit)
+    int idle_timeout_ms;    // Time a client may send nothing (0 for no limit)
+    int scan;           // The scanning level to use, if the CPU has it
+};
+
+void config_init(struct config *cfg);
+int config_set(struct config *cfg, const char *key, const char *value);
+int config_option(struct config *cfg, char *option);
+void config_file(struct config *cfg, const char *filename);
+void config_print(struct config *cfg, FILE *fp);
+
+#endif
@@ -2,28 +2,67 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdarg.h>
+#include <arpa/inet.h>
 
 #include "gameplay.h"
+#include "leaderboard.h"
+#include "render.h"
+#include "scan.h"
+
+// Set to 0 to stop the game logging what it does to stdout
+int game_verbose = 1;
+
+void game_log(const char *format, ...) {
+    va_list args;
+    if (game_verbose) {
+        va_start(args, format);
+        vprintf(format, args);
+        va_end(args);
+    }
+}
 
 /* Return a status message that shows the current state of the game.
- * Assumes that the caller has allocated MAX_MSG bytes for msg.
+ * Assumes that the caller has allocated MAX_STATUS bytes for msg.
  */
 char *status_message(char *msg, struct game_state *game) {
-    sprintf(msg, "***************\r\n"
-           "Word to guess: %s\r\nGuesses remaining: %d\r\n"
-           "Letters guessed: \r\n", game->guess, game->guesses_left);
-    for(int i = 0; i < 26; i++){
-        if(game->letters_guessed[i]) {
-            int len = strlen(msg);
-            msg[len] = (char)('a' + i);
-            msg[len + 1] = ' ';
-            msg[len + 2] = '\0';
-        }
-    }
-    strncat(msg, "\r\n***************\r\n", MAX_MSG);
+    struct msgbuf m = {msg, 0, MAX_STATUS - 1};
+    render_status(&m, game);
+    msg[m.len] = '\0';
     return msg;
 }
 
+/* Add the status of the game to m. Return the number of bytes added,
+ * which is never more than MAX_STATUS - 1.
+ */
+int render_status(struct msgbuf *m, struct game_state *game) {
+    int start = m->len;
+    put_lit(m, STATUS_HEAD);
+    put_str(m, game->guess);
+    put_lit(m, STATUS_GUESSES);
+    put_int(m, game->guesses_left);
+    put_lit(m, STATUS_LETTERS);
+    if (m->size - m->len >= 2 * NUM_LETTERS) {
+        // Write every letter and only move past the guessed ones
+        char *dst = m->buf + m->len;
+        for (int i = 0; i < NUM_LETTERS; i++) {
+            dst[0] = 'a' + i;
+            dst[1] = ' ';
+            dst += 2 * (game->letters_guessed[i] != 0);
+        }
+        m->len = dst - m->buf;
+    } else {
+        for (int i = 0; i < NUM_LETTERS; i++) {
+            if (game->letters_guessed[i]) {
+                put_char(m, 'a' + i);
+                put_char(m, ' ');
+            }
+        }
+    }
+    put_lit(m, STATUS_TAIL);
+    return m->len - start;
+}
+
 
 /* Initialize the gameboard: 
  *    - initialize dictionary
@@ -47,7 +86,7 @@ void init_game(struct game_state *game, char *dict_name) {
     } 
 
     int index = random() % game->dict.size;
-    printf("Looking for word at index %d\n", index);
+    game_log("Looking for word at index %d\n", index);
     for(int i = 0; i <= index; i++) {
         if(!fgets(buf, MAX_WORD, game->dict.fp)){
             fprintf(stderr,"File ended before we found the entry index %d",index);
@@ -71,7 +110,7 @@ void init_game(struct game_state *game, char *dict_name) {
     for(int i = 0; i < NUM_LETTERS; i++) {
         game->letters_guessed[i] = 0;
     }
-    game->guesses_left = MAX_GUESSES;
+    game->guesses_left = game->max_guesses;
 
 }
 
@@ -94,3 +133,478 @@ int get_file_length(char *filename) {
     fclose(fp);
     return count;
 }
+
+
+void output_init(struct output_list *out) {
+    out->items = NULL;
+    out->count = 0;
+    out->size = 0;
+    out->text = NULL;
+    out->text_len = 0;
+    out->text_size = 0;
+}
+
+void output_free(struct output_list *out) {
+    free(out->items);
+    free(out->text);
+    output_init(out);
+}
+
+// Empty the list, keeping its memory for the next event
+void output_reset(struct output_list *out) {
+    out->count = 0;
+    out->text_len = 0;
+}
+
+// Make sure there is room for len more bytes of text
+static void output_room(struct output_list *out, int len) {
+    if (out->text_len + len > out->text_size) {
+        while (out->text_len + len > out->text_size) {
+            out->text_size = out->text_size ? 2 * out->text_size : 4096;
+        }
+        out->text = realloc(out->text, out->text_size);
+        if (out->text == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+}
+
+/* Add an output whose len bytes of text are already at the end of the
+ * list's text, growing the list if it is full.
+ */
+static void add_output(struct output_list *out, int type, int fd, int len) {
+    if (out->count == out->size) {
+        out->size = out->size ? 2 * out->size : 16;
+        out->items = realloc(out->items, out->size * sizeof(struct game_output));
+        if (out->items == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    struct game_output *o = &out->items[out->count++];
+    o->type = type;
+    o->fd = fd;
+    o->start = out->text_len;
+    o->len = len;
+    out->text_len += len;
+}
+
+/* Return a msgbuf over the free end of the output text with room for size
+ * bytes. Render a message into it and pass it to output_send before
+ * asking for more space.
+ */
+struct msgbuf output_space(struct game_state *game, int size) {
+    output_room(game->out, size);
+    struct msgbuf m = {game->out->text + game->out->text_len, 0, size};
+    return m;
+}
+
+// Ask for what was rendered into m (from output_space) to be sent to fd
+void output_send(struct game_state *game, int fd, struct msgbuf *m) {
+    if (m->len > 0) {
+        add_output(game->out, OUT_SEND, fd, m->len);
+    }
+}
+
+// Ask for len bytes of msg to be sent to one client
+void send_message(struct game_state *game, int fd, const char *msg, int len) {
+    struct msgbuf m = output_space(game, len);
+    put_bytes(&m, msg, len);
+    output_send(game, fd, &m);
+}
+
+// Send a string to one client
+void send_text(struct game_state *game, int fd, const char *msg) {
+    send_message(game, fd, msg, strlen(msg));
+}
+
+// Send a string to a client who is not in a game
+void output_text(struct output_list *out, int fd, const char *msg) {
+    int len = strlen(msg);
+    output_room(out, len);
+    memcpy(out->text + out->text_len, msg, len);
+    add_output(out, OUT_SEND, fd, len);
+}
+
+// Ask for fd to be closed
+void output_close(struct output_list *out, int fd) {
+    add_output(out, OUT_CLOSE, fd, 0);
+}
+
+/* Give one event from a player seated in the room to the room's game.
+ * Joining and naming are handled by the lobby, which seats players in
+ * rooms. What the game wants done about the event is added to out (which
+ * the caller empties with output_reset); the return value is the number of
+ * outputs in out.
+ */
+int game_apply(struct room *room, struct game_event *ev, struct output_list *out) {
+    struct game_state *game = &(room->game);
+    struct client *p;
+
+    game->out = out;
+    if (ev->type == EV_LINE) {
+        if ((p = find_client(game->head, ev->fd)) != NULL) {
+            handle_guess(game, p, ev->text, room->dict_name);
+        }
+    } else if (ev->type == EV_LEAVE) {
+        remove_player(game, &(game->head), ev->fd);
+    } else if (ev->type == EV_TICK) {
+        flush_updates(game);
+    }
+    game->out = NULL;
+    return out->count;
+}
+
+// Check if a player exists according to where they are placed
+int check_play(struct client **top, int fd) {
+    struct client *p;
+    int exist = 0;
+    for (p = *top; p != NULL; p = p->next) {
+        if (p->fd == fd) {
+            exist = 1;
+            break;
+        }
+    }
+    return exist;
+}
+
+// Return the client with socket descriptor fd, or NULL if it is not in the list
+struct client *find_client(struct client *top, int fd) {
+    struct client *p;
+    for (p = top; p != NULL; p = p->next) {
+        if (p->fd == fd) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/* Add a client with an input buffer of in_size bytes to the head of the
+ * linked list
+ */
+void add_player(struct client **top, int fd, struct in_addr addr, int in_size) {
+    struct client *p = malloc(sizeof(struct client));
+    char *inbuf = malloc(in_size);
+
+    if (!p || !inbuf) {
+        perror("malloc");
+        exit(1);
+    }
+
+    game_log("Adding client %s\n", inet_ntoa(addr));
+
+    p->fd = fd;
+    p->ipaddr = addr;
+    p->name[0] = '\0';
+    p->inbuf = inbuf;
+    p->in_size = in_size;
+    p->in_ptr = p->inbuf;
+    p->inbuf[0] = '\0';
+    p->status_wanted = 0;
+    p->limit.tokens = 0;
+    p->limit.last_ms = 0;
+    p->strikes = 0;
+    p->strike_ms = 0;
+    p->joined_ms = 0;
+    p->last_ms = 0;
+    p->state = CLIENT_NEW;
+    p->queued_ms = 0;
+    p->room = NULL;
+    p->score = 0;
+    p->wins = 0;
+    p->rounds = 0;
+    p->board_prev = NULL;
+    p->board_next = NULL;
+    p->next = *top;
+    *top = p;
+}
+
+/* Removes client from the linked list and closes its connection.
+ */
+void remove_player(struct game_state *game, struct client **top, int fd) {
+    struct client **p;
+
+    for (p = top; *p && (*p)->fd != fd; p = &(*p)->next)
+    ;
+    // Now, p points to (1) top, or (2) a pointer to another client
+    // This avoids a special case for removing the head of the list
+    if (*p) {
+        struct client *gone = *p;
+        struct client *t = (*p)->next;
+        game_log("Disconnect from %s\n", inet_ntoa((*p)->ipaddr));
+        game_log("Removing client %d %s\n", fd, inet_ntoa((*p)->ipaddr));
+
+        // Tell the other players when a named player leaves, in turn with
+        // the other updates queued for the flush
+        if ((*p)->name[0] != '\0'){
+            struct msgbuf m = queue_space(game, MAX_MSG);
+            put_lit(&m, "Goodbye ");
+            put_str(&m, (*p)->name);
+            put_lit(&m, "\r\n");
+            queue_commit(game, &m);
+        }
+
+        add_output(game->out, OUT_CLOSE, (*p)->fd, 0);
+        free((*p)->inbuf);
+        free(*p);
+        *p = t;
+        // Don't leave the turn with a player who is gone
+        if (game->has_next_turn == gone) {
+            game->has_next_turn = (t != NULL) ? t : game->head;
+            game->turn_dirty = 1;
+        }
+        if (game->has_next_turn != NULL && game->head == NULL) {
+            game->has_next_turn = NULL;
+        } 
+    } else {
+        fprintf(stderr, "Trying to remove fd %d, but I don't know about it\n", fd);
+    }
+}
+
+// Removes a client from a list without freeing it
+void remove_new_player(struct client **top, int fd) {
+    struct client **p;
+    for (p = top; *p && (*p)->fd != fd; p = &(*p)->next);
+    if (*p) {
+        struct client *t = (*p)->next;
+        game_log("Removing client %d from new players\n", fd);
+        *p = t;
+    }
+}
+
+/* Return a msgbuf over the free end of the updates for all active players,
+ * with room for size bytes (at most MAX_PENDING). Render a message into it
+ * and pass it to queue_commit.
+ */
+struct msgbuf queue_space(struct game_state *game, int size) {
+    if (game->pending_len + size > MAX_PENDING) {
+        flush_updates(game);
+    }
+    struct msgbuf m = {game->pending + game->pending_len, 0, size};
+    return m;
+}
+
+void queue_commit(struct game_state *game, struct msgbuf *m) {
+    game->pending_len += m->len;
+}
+
+// Queue the current status in place, so that it shows the board as it is now
+// rather than as it is at the flush (used before a new game is started)
+void queue_status(struct game_state *game) {
+    struct msgbuf m = queue_space(game, MAX_STATUS);
+    render_status(&m, game);
+    queue_commit(game, &m);
+    game->status_dirty = 0;
+}
+
+/* Send the updates gathered during this pass of the select loop. Each player
+ * gets one write: the queued messages, then the status if it changed, then
+ * whose turn it is if the turn changed.
+ */
+void flush_updates(struct game_state *game) {
+    char status_buf[MAX_STATUS];
+    struct msgbuf status = {status_buf, 0, MAX_STATUS};
+    struct client *p;
+
+    for (p = game->head; p != NULL; p = p->next) {
+        // Render straight into the output for this player
+        struct msgbuf m = output_space(game, game->pending_len + MAX_STATUS + MAX_TURN);
+        put_bytes(&m, game->pending, game->pending_len);
+        if (game->status_dirty || p->status_wanted) {
+            if (status.len == 0) {
+                render_status(&status, game);
+            }
+            put_bytes(&m, status.buf, status.len);
+        }
+        p->status_wanted = 0;
+        if (game->turn_dirty && game->has_next_turn != NULL) {
+            if (game->has_next_turn == p) {
+                put_lit(&m, YOUR_TURN);
+            } else {
+                put_lit(&m, TURN_HEAD);
+                put_str(&m, game->has_next_turn->name);
+                put_lit(&m, TURN_TAIL);
+            }
+        }
+        output_send(game, p->fd, &m);
+    }
+    game->pending_len = 0;
+    game->status_dirty = 0;
+    game->turn_dirty = 0;
+}
+
+// Announce winner's name to playing players.
+void announce_winner(struct game_state *game, struct client *winner) {
+    struct client *p;
+    p = game->head;
+    while (p != NULL) {
+        struct msgbuf m = output_space(game, MAX_MSG);
+        if (strcmp(p->name, winner->name) == 0) { 
+            put_lit(&m, YOU_WIN);
+        } else {
+            put_lit(&m, WINNER_HEAD);
+            put_str(&m, winner->name);
+            put_lit(&m, WINNER_TAIL);
+        }
+        output_send(game, p->fd, &m);
+        p = p->next;
+    }
+}
+
+/* Count a finished round for everyone seated and a win for the winner
+ * (NULL if the guesses ran out)
+ */
+void end_round(struct game_state *game, struct client *winner) {
+    for (struct client *p = game->head; p != NULL; p = p->next) {
+        p->rounds++;
+    }
+    if (winner != NULL) {
+        winner->wins++;
+        if (game->board != NULL) {
+            board_add(game->board, winner, WIN_POINTS);
+        }
+    }
+}
+
+// Change the has_next_turn pointer to the next active player
+void advance_turn(struct game_state *game) {
+    if ((game->has_next_turn)->next != NULL) {
+        game->has_next_turn = game->has_next_turn->next;
+    } else {
+        game->has_next_turn = game->head;
+    }
+}
+// helper to see if the letter has been guessed
+int valid_guess_guessed(struct game_state *game, char guess){
+    int result = 0;
+    if(game->letters_guessed[(int)guess - 97] == 1){
+        result = 1;
+    }
+    return result;
+}
+
+// Check that the line a player sent is a valid guess
+int guess_word(struct game_state *game, int fd, char *guess,  char *name) {
+    if (fd != (game->has_next_turn)->fd) {
+        game_log("[%d] Read %d bytes\n", fd, (int)strlen(guess) + 2);
+        game_log("Player %s try to guess out of turn\n", name);
+        send_text(game, fd, "It's not your turn to guess\r\n");
+        return 1;
+    }
+    int len = strlen(guess);
+    int letters = scan_letters(guess, len);
+    if (letters == 0) {
+        send_text(game, fd, "Please enter a valid letter\r\n");
+        return 1;
+    }else if (len != 1){
+        send_text(game, fd, "Please enter a single letter\r\n");
+        return 1;
+    }else if (valid_guess_guessed(game, guess[0]) == 1){
+        send_text(game, fd, "Please enter a letter that is not guessed\r\n");
+        return 1;
+    }
+    return 0;
+}
+
+// Update the guessed word
+int update(struct game_state *game, char *guess) {
+    int correct = 1;
+    int current_guess_length = strlen(game->word);
+    for (int i = 0; i < current_guess_length; i++) {
+        if (game->guess[i] == '-' && game->word[i] == *guess) {
+            game->guess[i] = guess[0];
+            correct = 0;
+            game->guesses_left -= 1;
+        }
+    }
+    game->letters_guessed[guess[0] - 97] = 1;
+    return correct;
+}
+
+// helper to check if the game is over
+int is_over(struct game_state *game){
+    if ((strcmp(game->guess ,game->word) == 0) || game->guesses_left == 0 ) {
+        return 0;
+    }
+    return 1;
+}
+
+// Check if the game must end due to no guessing chance left
+int check_over(struct game_state *game) {
+    if (is_over(game) == 0) {
+        queue_status(game);
+        struct msgbuf m = queue_space(game, MAX_MSG);
+        put_lit(&m, "The word is ");
+        put_str(&m, game->word);
+        put_lit(&m, NO_GUESSES);
+        queue_commit(game, &m);
+        return 1;
+    }
+    return 0;
+}
+
+// Handle a guess from an active player
+void handle_guess(struct game_state *game, struct client *p, char *guess, char *dict_name) {
+    int cur_fd = p->fd;
+    struct msgbuf m;
+
+    // Guesses are not case sensitive
+    scan_lower(guess, strlen(guess));
+    int valid = guess_word(game, cur_fd, guess, p->name);
+    if (valid != 0 || !check_play(&(game->head), cur_fd)) {
+        return;
+    }
+    game_log("[%d] Read %d bytes\n", cur_fd, (int)strlen(guess) + 2);
+    game_log("[%d] newline %s\n",cur_fd, guess);
+    int correct = update(game, guess);
+    if (correct == 0 && game->board != NULL) {
+        board_add(game->board, p, LETTER_POINTS);
+    }
+    if (strcmp(game->guess, game->word) == 0) {
+        m = queue_space(game, MAX_MSG);
+        put_lit(&m, "The word was ");
+        put_str(&m, game->word);
+        put_lit(&m, "\r\n");
+        queue_commit(game, &m);
+        // The winner message differs per player, so
+        // send what is queued ahead of it
+        flush_updates(game);
+        announce_winner(game, p);
+        end_round(game, p);
+        init_game(game, dict_name);
+        game->turn_dirty = 1;
+        game_log("Game over. %s won!\n", p->name);
+        game_log("New game\n");
+        if (game->has_next_turn != NULL) {
+            game_log("It's %s's turn.\n", (game->has_next_turn)->name);
+        }
+    } else { 
+        if (correct == 1) {
+            m = output_space(game, MAX_MSG);
+            put_char(&m, guess[0]);
+            put_lit(&m, " not in the word\n");
+            output_send(game, cur_fd, &m);
+            game->guesses_left -= 1;
+            if (game->has_next_turn != NULL) {
+                advance_turn(game);
+            }
+            game_log("Letter %c is not in the word\n", guess[0]);
+        }
+        m = queue_space(game, MAX_MSG);
+        put_str(&m, p->name);
+        put_lit(&m, " guesses: ");
+        put_char(&m, guess[0]);
+        put_lit(&m, "\r\n");
+        queue_commit(game, &m);
+        game->status_dirty = 1;
+        game->turn_dirty = 1;
+        if (check_over(game)) {
+            end_round(game, NULL);
+            init_game(game, dict_name);
+        }
+        if (game->has_next_turn != NULL) {
+            game_log("It's %s's turn.\n", (game->has_next_turn)->name);
+        }
+    }
+}
@@ -1,20 +1,74 @@
+#ifndef _GAMEPLAY_H_
+#define _GAMEPLAY_H_
+
 #include <netinet/in.h>
 
+#include "ratelimit.h"
+#include "render.h"
+
 #define MAX_NAME 30  
 #define MAX_MSG 128
 #define MAX_WORD 20
-#define MAX_BUF 256
-#define MAX_GUESSES 4
+#define MAX_BUF 256       // Default size of a client's input buffer
+#define MAX_LINE 4096     // Largest input buffer that can be configured
+#define MAX_GUESSES 4     // Default number of wrong guesses in a round
 #define NUM_LETTERS 26
+#define MAX_PENDING 1024
+#define MAX_STATUS 192    // Longest status: a full word and every letter guessed
+#define MAX_TURN (MAX_NAME + 16)
 #define WELCOME_MSG "Welcome to our word game. What is your name? "
+#define WAIT_MSG "Please wait for a game to start\r\n"
+
+/* Output from the game: things the program running it must do */
+#define OUT_SEND 1      // Send len bytes starting at text + start to fd
+#define OUT_CLOSE 2     // Close fd; the client has been removed
+
+struct game_output {
+    int type;
+    int fd;
+    int start;
+    int len;
+};
+
+struct output_list {
+    struct game_output *items;
+    int count;
+    int size;
+    char *text;               // The bytes to send, for all of the outputs
+    int text_len;
+    int text_size;
+};
+
+/* Where a client is: entering a name, waiting for a seat or playing */
+#define CLIENT_NEW 0
+#define CLIENT_WAITING 1
+#define CLIENT_PLAYING 2
+
+struct room;
+struct leaderboard;
 
 struct client {
     int fd;
     struct in_addr ipaddr;
     struct client *next;
     char name[MAX_NAME];
-    char inbuf[MAX_BUF];  // Used to hold input from the client
+    char *inbuf;          // Used to hold input from the client
+    int in_size;          // Size of inbuf
     char *in_ptr;         // A pointer into inbuf to help with partial reads
+    int status_wanted;    // 1 if this client should get the status at the next flush
+    struct bucket limit;  // Budget for the lines this client sends (set by the server)
+    int strikes;          // Lines dropped for being over budget
+    long strike_ms;       // When the last strike was counted
+    long joined_ms;       // When the client connected (set by the server)
+    long last_ms;         // When the client last sent something (set by the server)
+    int state;            // CLIENT_NEW, CLIENT_WAITING or CLIENT_PLAYING
+    long queued_ms;       // When the client started waiting for a seat
+    struct room *room;    // The room the client is playing in
+    int score;            // Points over every round the client has played
+    int wins;
+    int rounds;           // Rounds finished while the client was seated
+    struct client *board_prev;  // Other players with the same score
+    struct client *board_next;
 };
 
 // Information about the dictionary used to pick random word
@@ -28,13 +82,93 @@ struct game_state {
     char guess[MAX_WORD];     // The current guess (for example '-o-d')
     int letters_guessed[NUM_LETTERS]; // Index i will be 1 if the corresponding ??letter has been guessed; 0 otherwise
     int guesses_left;         // Number of guesses remaining
+    int max_guesses;          // Guesses at the start of a round
     struct dictionary dict;
     
     struct client *head;
     struct client *has_next_turn;
+
+    // Updates gathered during one pass of the select loop. They are sent to
+    // every player in a single write when the pass is over.
+    char pending[MAX_PENDING];
+    int pending_len;
+    int status_dirty;         // 1 if the status should go to everyone at the flush
+    int turn_dirty;           // 1 if the turn should be announced at the flush
+
+    struct output_list *out;  // Where output goes while game_apply is running
+    struct leaderboard *board;  // Where points are recorded, or NULL
+};
+
+/* One game and the players seated in it. Players are kept in the order
+ * they were seated, which is the order their turns come round in.
+ */
+struct room {
+    struct game_state game;
+    char *dict_name;
+    int id;
+    int players;              // Number of players in game.head
+    int dirty;                // 1 if the room is on the lobby's list to flush
+    struct room *dirty_next;
+    struct room *next;
+};
+
+/* Input to the game. The program that runs the game turns what happens on
+ * its connections into these and passes them to game_apply.
+ */
+#define EV_JOIN 1       // A client connected from addr
+#define EV_LINE 2       // A client sent the line in text
+#define EV_LEAVE 3      // A client has gone or must be dropped
+#define EV_TICK 4       // The end of a batch of input: send what is queued
+
+struct game_event {
+    int type;
+    int fd;
+    struct in_addr addr;
+    char *text;
+    long ms;        // When it happened, in ms since the game started
 };
 
 
 void init_game(struct game_state *game, char *dict_name);
 int get_file_length(char *filename);
-char *status_message(char *msg, struct game_state *game);
\ No newline at end of file
+char *status_message(char *msg, struct game_state *game);
+int render_status(struct msgbuf *m, struct game_state *game);
+
+extern int game_verbose;
+void game_log(const char *format, ...);
+
+int game_apply(struct room *room, struct game_event *ev, struct output_list *out);
+void output_init(struct output_list *out);
+void output_reset(struct output_list *out);
+void output_free(struct output_list *out);
+struct msgbuf output_space(struct game_state *game, int size);
+void output_send(struct game_state *game, int fd, struct msgbuf *m);
+void send_message(struct game_state *game, int fd, const char *msg, int len);
+void send_text(struct game_state *game, int fd, const char *msg);
+void output_text(struct output_list *out, int fd, const char *msg);
+void output_close(struct output_list *out, int fd);
+
+void add_player(struct client **top, int fd, struct in_addr addr, int in_size);
+void remove_player(struct game_state *game, struct client **top, int fd);
+struct msgbuf queue_space(struct game_state *game, int size);
+void queue_commit(struct game_state *game, struct msgbuf *m);
+void queue_status(struct game_state *game);
+/* Send everything queued during one pass of the select loop */
+void flush_updates(struct game_state *game);
+int check_play(struct client **top, int fd);
+struct client *find_client(struct client *top, int fd);
+void announce_winner(struct game_state *game, struct client *winner);
+void end_round(struct game_state *game, struct client *winner);
+/* Move the has_next_turn pointer to the next active client */
+void advance_turn(struct game_state *game);
+/* Handle one line of input from a player */
+void handle_guess(struct game_state *game, struct client *p, char *guess, char *dict_name);
+/* The following are helpers */
+int guess_word(struct game_state *game, int fd, char *guess,  char *username);
+int update(struct game_state *game, char *guess);
+int check_over(struct game_state *game);
+void remove_new_player(struct client **top, int fd);
+int is_over(struct game_state *game);
+int valid_guess_guessed(struct game_state *game, char guess);
+
+#endif
@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "journal.h"
+
+// Store n in the first size bytes of buf, lowest byte first
+static void put_le(unsigned char *buf, unsigned long n, int size) {
+    for (int i = 0; i < size; i++) {
+        buf[i] = (n >> (8 * i)) & 0xff;
+    }
+}
+
+static unsigned long get_le(const unsigned char *buf, int size) {
+    unsigned long n = 0;
+    for (int i = size - 1; i >= 0; i--) {
+        n = (n << 8) | buf[i];
+    }
+    return n;
+}
+
+/* Create a journal file and write its header.
+ * Terminate with exit code 1 if the file can't be created.
+ */
+FILE *journal_create(char *filename, struct journal_header *h) {
+    unsigned char header[24];
+    FILE *fp = fopen(filename, "wb");
+    if (fp == NULL) {
+        perror("Opening journal");
+        exit(1);
+    }
+    memcpy(header, JOURNAL_MAGIC, 4);
+    put_le(header + 4, h->seed, 4);
+    put_le(header + 8, h->dict_size, 4);
+    put_le(header + 12, h->max_guesses, 4);
+    put_le(header + 16, h->room_size, 4);
+    put_le(header + 20, h->max_wait_ms, 4);
+    if (fwrite(header, sizeof(header), 1, fp) != 1) {
+        perror("Writing journal");
+        exit(1);
+    }
+    return fp;
+}
+
+/* Append one record. Records are buffered by stdio; the caller flushes
+ * once per pass of the select loop.
+ */
+void journal_write(FILE *fp, long ms, int kind, int fd, const void *data, int len) {
+    unsigned char rec[9];
+    put_le(rec, ms, 4);
+    rec[4] = kind;
+    put_le(rec + 5, fd, 2);
+    put_le(rec + 7, len, 2);
+    if (fwrite(rec, sizeof(rec), 1, fp) != 1 ||
+        (len > 0 && fwrite(data, len, 1, fp) != 1)) {
+        perror("Writing journal");
+    }
+}
+
+/* Open a journal for reading and return what its header holds in h.
+ * Terminate with exit code 1 if it is not a journal.
+ */
+FILE *journal_open(char *filename, struct journal_header *h) {
+    unsigned char header[24];
+    FILE *fp = fopen(filename, "rb");
+    if (fp == NULL) {
+        perror("Opening journal");
+        exit(1);
+    }
+    if (fread(header, sizeof(header), 1, fp) != 1 ||
+        memcmp(header, JOURNAL_MAGIC, 4) != 0) {
+        fprintf(stderr, "%s is not a journal\n", filename);
+        exit(1);
+    }
+    h->seed = get_le(header + 4, 4);
+    h->dict_size = get_le(header + 8, 4);
+    h->max_guesses = get_le(header + 12, 4);
+    h->room_size = get_le(header + 16, 4);
+    h->max_wait_ms = get_le(header + 20, 4);
+    return fp;
+}
+
+/* Read the next record into r.
+ * Return 1 on success and 0 at the end of the journal.
+ */
+int journal_read(FILE *fp, struct journal_record *r) {
+    unsigned char rec[9];
+    if (fread(rec, sizeof(rec), 1, fp) != 1) {
+        return 0;
+    }
+    r->ms = get_le(rec, 4);
+    r->kind = rec[4];
+    r->fd = get_le(rec + 5, 2);
+    r->len = get_le(rec + 7, 2);
+    if (r->len >= MAX_LINE ||
+        (r->len > 0 && fread(r->data, r->len, 1, fp) != 1)) {
+        fprintf(stderr, "Journal record is damaged\n");
+        return 0;
+    }
+    r->data[r->len] = '\0';
+    return 1;
+}
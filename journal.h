@@ -0,0 +1,53 @@
+#ifndef _JOURNAL_H_
+#define _JOURNAL_H_
+
+#include <stdio.h>
+
+#include "gameplay.h"
+
+/* A journal records what the server was given, so that a run can be fed
+ * through the game again without any sockets. The file starts with a
+ * header followed by records. The header holds the magic, the random
+ * seed, the dictionary length and the settings that change how the game
+ * plays (max_guesses, room_size and max_wait_ms), 4 bytes each. Records are:
+ *
+ *     4 bytes  milliseconds since recording started
+ *     1 byte   kind of record
+ *     2 bytes  socket descriptor
+ *     2 bytes  length of the data
+ *     data     client address for J_CONNECT, the line for J_LINE,
+ *              nothing for the others
+ *
+ * All numbers are little endian.
+ */
+#define JOURNAL_MAGIC "WGJ2"
+
+// The kinds of record are the game events they hold
+#define J_CONNECT EV_JOIN   // A client connected
+#define J_LINE EV_LINE      // A complete line was accepted from a client
+#define J_CLOSE EV_LEAVE    // A client left or was dropped
+#define J_TICK EV_TICK      // The end of one pass of the select loop
+
+struct journal_record {
+    long ms;
+    int kind;
+    int fd;
+    int len;
+    char data[MAX_LINE];
+};
+
+// What a replay needs to set the game up as it was recorded
+struct journal_header {
+    unsigned int seed;
+    int dict_size;
+    int max_guesses;
+    int room_size;
+    int max_wait_ms;
+};
+
+FILE *journal_create(char *filename, struct journal_header *h);
+void journal_write(FILE *fp, long ms, int kind, int fd, const void *data, int len);
+FILE *journal_open(char *filename, struct journal_header *h);
+int journal_read(FILE *fp, struct journal_record *r);
+
+#endif
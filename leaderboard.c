@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "leaderboard.h"
+
+// Where a score goes in the tree: slot 1 holds the highest scores
+static int score_slot(int score) {
+    if (score >= BOARD_SCORES) {
+        score = BOARD_SCORES - 1;
+    }
+    return BOARD_SCORES - score;
+}
+
+// Add delta to the count of players in slot i
+static void tree_add(struct leaderboard *board, int i, int delta) {
+    for (; i <= BOARD_SCORES; i += i & -i) {
+        board->tree[i] += delta;
+    }
+}
+
+// Return the number of players in slots 1 to i
+static int tree_sum(struct leaderboard *board, int i) {
+    int sum = 0;
+    for (; i > 0; i -= i & -i) {
+        sum += board->tree[i];
+    }
+    return sum;
+}
+
+// Return the slot of the k-th best player (k from 1 to board->players)
+static int tree_find(struct leaderboard *board, int k) {
+    int i = 0;
+    for (int step = BOARD_SCORES; step > 0; step >>= 1) {
+        if (i + step <= BOARD_SCORES && board->tree[i + step] < k) {
+            i += step;
+            k -= board->tree[i];
+        }
+    }
+    return i + 1;
+}
+
+void board_init(struct leaderboard *board) {
+    board->tree = calloc(BOARD_SCORES + 1, sizeof(int));
+    board->slot = calloc(BOARD_SCORES + 1, sizeof(struct client *));
+    if (board->tree == NULL || board->slot == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+    board->players = 0;
+}
+
+void board_free(struct leaderboard *board) {
+    free(board->tree);
+    free(board->slot);
+    board->tree = NULL;
+    board->slot = NULL;
+    board->players = 0;
+}
+
+// Rank a player who has just been given a name
+void board_insert(struct leaderboard *board, struct client *p) {
+    int i = score_slot(p->score);
+    tree_add(board, i, 1);
+    p->board_prev = NULL;
+    p->board_next = board->slot[i];
+    if (p->board_next != NULL) {
+        p->board_next->board_prev = p;
+    }
+    board->slot[i] = p;
+    board->players++;
+}
+
+void board_remove(struct leaderboard *board, struct client *p) {
+    int i = score_slot(p->score);
+    tree_add(board, i, -1);
+    if (p->board_prev != NULL) {
+        p->board_prev->board_next = p->board_next;
+    } else {
+        board->slot[i] = p->board_next;
+    }
+    if (p->board_next != NULL) {
+        p->board_next->board_prev = p->board_prev;
+    }
+    board->players--;
+}
+
+// Give a player points and move them to their new place
+void board_add(struct leaderboard *board, struct client *p, int points) {
+    board_remove(board, p);
+    p->score += points;
+    board_insert(board, p);
+}
+
+// Return the player's rank: 1 plus the number of players with more points
+int board_rank(struct leaderboard *board, struct client *p) {
+    return tree_sum(board, score_slot(p->score) - 1) + 1;
+}
+
+/* Put up to n of the best players in top, best first, and return how many
+ * there are. Each score that has players is found with one search of the
+ * tree, so this takes O(n log BOARD_SCORES).
+ */
+int board_top(struct leaderboard *board, struct client **top, int n) {
+    int count = 0;
+    int k = 1;
+    while (count < n && k <= board->players) {
+        int i = tree_find(board, k);
+        for (struct client *p = board->slot[i]; p != NULL && count < n; p = p->board_next) {
+            top[count++] = p;
+        }
+        k = tree_sum(board, i) + 1;
+    }
+    return count;
+}
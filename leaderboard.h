@@ -0,0 +1,30 @@
+#ifndef _LEADERBOARD_H_
+#define _LEADERBOARD_H_
+
+#include "gameplay.h"
+
+#define LETTER_POINTS 1         // Points for guessing a letter in the word
+#define WIN_POINTS 10           // Points for guessing the last letter
+#define BOARD_SCORES 65536      // Scores ranked exactly (a power of 2); higher ones tie
+#define TOP_MAX 10              // Most players /top will list
+
+/* The players who have a name, ranked by score. A Fenwick tree counts the
+ * players with each score, highest score first, so the number of players
+ * ahead of a score and the score of the k-th player are found in
+ * O(log BOARD_SCORES). The players with each score are kept in a list.
+ */
+struct leaderboard {
+    int *tree;                  // Fenwick tree over the slots, from 1
+    struct client **slot;       // Players with each score, highest score first
+    int players;
+};
+
+void board_init(struct leaderboard *board);
+void board_free(struct leaderboard *board);
+void board_insert(struct leaderboard *board, struct client *p);
+void board_remove(struct leaderboard *board, struct client *p);
+void board_add(struct leaderboard *board, struct client *p, int points);
+int board_rank(struct leaderboard *board, struct client *p);
+int board_top(struct leaderboard *board, struct client **top, int n);
+
+#endif
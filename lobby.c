@@ -0,0 +1,437 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "gameplay.h"
+#include "lobby.h"
+#include "render.h"
+
+// Upper bounds (exclusive) of the wait time buckets; the last one is open
+static const long wait_bounds[WAIT_BUCKETS - 1] = {10, 50, 100, 200, 500, 1000, 5000};
+
+// Set up a lobby with nobody in it and no rooms running
+void lobby_init(struct lobby *lobby, char *dict_name) {
+    memset(lobby, 0, sizeof(struct lobby));
+    lobby->dict_name = dict_name;
+    lobby->dict.size = get_file_length(dict_name);
+    // Every room picks its words from the same file; init_game rewinds it
+    lobby->dict.fp = fopen(dict_name, "r");
+    if (lobby->dict.fp == NULL) {
+        perror("Opening dictionary");
+        exit(1);
+    }
+    lobby->room_size = ROOM_SIZE;
+    lobby->max_wait_ms = MAX_WAIT_MS;
+    lobby->max_guesses = MAX_GUESSES;
+    lobby->buf_size = MAX_BUF;
+    board_init(&(lobby->board));
+}
+
+/* Free every client, room and the leaderboard and close the dictionary,
+ * without sending anything. The lobby can be set up again with lobby_init.
+ */
+void lobby_free(struct lobby *lobby) {
+    for (int fd = 0; fd < MAX_CLIENTS; fd++) {
+        if (lobby->clients[fd] != NULL) {
+            free(lobby->clients[fd]->inbuf);
+            free(lobby->clients[fd]);
+        }
+    }
+    while (lobby->rooms != NULL) {
+        struct room *next = lobby->rooms->next;
+        free(lobby->rooms);
+        lobby->rooms = next;
+    }
+    board_free(&(lobby->board));
+    fclose(lobby->dict.fp);
+    memset(lobby, 0, sizeof(struct lobby));
+}
+
+// Return the client with socket descriptor fd, or NULL if there is none
+struct client *lobby_client(struct lobby *lobby, int fd) {
+    if (fd < 0 || fd >= MAX_CLIENTS) {
+        return NULL;
+    }
+    return lobby->clients[fd];
+}
+
+/* Return the game of a room that is about to change, and make sure the
+ * room is flushed at the next tick.
+ */
+static struct game_state *use_room(struct lobby *lobby, struct room *room) {
+    room->game.out = lobby->out;
+    if (!room->dirty) {
+        room->dirty = 1;
+        room->dirty_next = lobby->dirty;
+        lobby->dirty = room;
+    }
+    return &(room->game);
+}
+
+// Start a room with a new word and no players
+struct room *room_create(struct lobby *lobby) {
+    struct room *room = malloc(sizeof(struct room));
+    if (!room) {
+        perror("malloc");
+        exit(1);
+    }
+    struct game_state *game = &(room->game);
+    game->dict = lobby->dict;
+    game->max_guesses = lobby->max_guesses;
+    init_game(game, lobby->dict_name);
+    game->head = NULL;
+    game->has_next_turn = NULL;
+    game->pending_len = 0;
+    game->status_dirty = 0;
+    game->turn_dirty = 0;
+    game->out = NULL;
+    game->board = &(lobby->board);
+    room->dict_name = lobby->dict_name;
+    room->id = lobby->next_room_id++;
+    room->players = 0;
+    room->dirty = 0;
+    room->next = lobby->rooms;
+    lobby->rooms = room;
+    lobby->open_seats += lobby->room_size;
+    lobby->stats.rooms_started++;
+    game_log("Starting room %d\n", room->id);
+    return room;
+}
+
+// Take a room that everyone has left off the list of rooms and free it
+static void room_free(struct lobby *lobby, struct room *room) {
+    struct room **r;
+    for (r = &(lobby->rooms); *r != NULL && *r != room; r = &(*r)->next)
+    ;
+    if (*r != NULL) {
+        *r = room->next;
+    }
+    lobby->open_seats -= lobby->room_size;
+    game_log("Closing room %d\n", room->id);
+    free(room);
+}
+
+// Add a named player to the end of the queue
+static void queue_push(struct lobby *lobby, struct client *p) {
+    p->next = NULL;
+    p->state = CLIENT_WAITING;
+    p->queued_ms = lobby->now_ms;
+    if (lobby->queue_tail != NULL) {
+        lobby->queue_tail->next = p;
+    } else {
+        lobby->queue_head = p;
+    }
+    lobby->queue_tail = p;
+    lobby->queue_depth++;
+    if (lobby->queue_depth > lobby->stats.depth_max) {
+        lobby->stats.depth_max = lobby->queue_depth;
+    }
+}
+
+// Take the player who has waited longest off the queue
+static struct client *queue_pop(struct lobby *lobby) {
+    struct client *p = lobby->queue_head;
+    lobby->queue_head = p->next;
+    if (lobby->queue_head == NULL) {
+        lobby->queue_tail = NULL;
+    }
+    lobby->queue_depth--;
+    p->next = NULL;
+    return p;
+}
+
+// Take a player who has left off the queue, wherever they are in it
+static void queue_remove(struct lobby *lobby, struct client *p) {
+    struct client **q;
+    struct client *prev = NULL;
+    for (q = &(lobby->queue_head); *q != NULL && *q != p; q = &(*q)->next) {
+        prev = *q;
+    }
+    if (*q == NULL) {
+        return;
+    }
+    *q = p->next;
+    if (lobby->queue_tail == p) {
+        lobby->queue_tail = prev;
+    }
+    lobby->queue_depth--;
+}
+
+// Count how long a player waited for their seat
+static void record_wait(struct match_stats *stats, long wait) {
+    int i = 0;
+    while (i < WAIT_BUCKETS - 1 && wait >= wait_bounds[i]) {
+        i++;
+    }
+    stats->waits[i]++;
+    stats->seated++;
+    stats->wait_total_ms += wait;
+    if (wait > stats->wait_max_ms) {
+        stats->wait_max_ms = wait;
+    }
+}
+
+/* Seat a waiting player in room. They go to the end of the list, so turns
+ * come round in the order players were seated.
+ */
+static void seat(struct lobby *lobby, struct room *room, struct client *p) {
+    struct game_state *game = use_room(lobby, room);
+    struct client **tail;
+
+    for (tail = &(game->head); *tail != NULL; tail = &(*tail)->next)
+    ;
+    p->next = NULL;
+    *tail = p;
+    p->state = CLIENT_PLAYING;
+    p->room = room;
+    room->players++;
+    lobby->open_seats--;
+    if (game->has_next_turn == NULL) {
+        game->has_next_turn = p;
+    }
+    record_wait(&(lobby->stats), lobby->now_ms - p->queued_ms);
+
+    struct msgbuf m = queue_space(game, MAX_MSG);
+    put_str(&m, p->name);
+    put_lit(&m, " has joined.\r\n");
+    queue_commit(game, &m);
+    p->status_wanted = 1;
+    game->turn_dirty = 1;
+    game_log("%s has joined room %d after %ld ms\n", p->name, room->id,
+        lobby->now_ms - p->queued_ms);
+}
+
+/* Seat the players who are waiting:
+ *    - in the free seats of rooms that are running, so they stay full
+ *    - room_size at a time in new rooms
+ *    - all together in a smaller room, once the longest wait is too long
+ */
+void lobby_match(struct lobby *lobby) {
+    struct room *room;
+
+    for (room = lobby->rooms; room != NULL; room = room->next) {
+        if (lobby->queue_depth == 0 || lobby->open_seats == 0) {
+            break;
+        }
+        while (room->players < lobby->room_size && lobby->queue_depth > 0) {
+            seat(lobby, room, queue_pop(lobby));
+        }
+    }
+    while (lobby->queue_depth >= lobby->room_size) {
+        room = room_create(lobby);
+        for (int i = 0; i < lobby->room_size; i++) {
+            seat(lobby, room, queue_pop(lobby));
+        }
+    }
+    if (lobby->queue_depth > 0 &&
+            lobby->now_ms - lobby->queue_head->queued_ms >= lobby->max_wait_ms) {
+        room = room_create(lobby);
+        lobby->stats.rooms_small++;
+        while (lobby->queue_depth > 0) {
+            seat(lobby, room, queue_pop(lobby));
+        }
+    }
+}
+
+/* Return how many ms after now the next tick is needed to seat the player
+ * who has waited longest, or -1 if nobody is waiting.
+ */
+long lobby_timeout(struct lobby *lobby, long now) {
+    if (lobby->queue_head == NULL) {
+        return -1;
+    }
+    long left = lobby->queue_head->queued_ms + lobby->max_wait_ms - now;
+    return (left > 0) ? left : 0;
+}
+
+// Print the queue depth and how long players have waited for a seat
+void lobby_report(struct lobby *lobby, FILE *fp) {
+    struct match_stats *stats = &(lobby->stats);
+
+    fprintf(fp, "queue: %d waiting (at most %d), %d free seats\n",
+        lobby->queue_depth, stats->depth_max, lobby->open_seats);
+    fprintf(fp, "rooms: %ld started, %ld with fewer than %d players\n",
+        stats->rooms_started, stats->rooms_small, lobby->room_size);
+    fprintf(fp, "seated: %ld, wait %.1f ms average, %ld ms longest\n", stats->seated,
+        stats->seated ? (double)stats->wait_total_ms / stats->seated : 0.0,
+        stats->wait_max_ms);
+    fprintf(fp, "wait:");
+    for (int i = 0; i < WAIT_BUCKETS - 1; i++) {
+        fprintf(fp, " <%ldms %ld", wait_bounds[i], stats->waits[i]);
+    }
+    fprintf(fp, " more %ld\n", stats->waits[WAIT_BUCKETS - 1]);
+}
+
+// Check that the line a new player sent is a usable name
+int read_username(char *name, struct lobby *lobby, int fd) {
+    struct client *player;
+    struct room *room;
+
+    for (player = lobby->queue_head; player != NULL; player = player->next) {
+        if (strcmp(player->name, name) == 0) {
+            output_text(lobby->out, fd, "Please enter a not used username");
+            return 1;
+        }
+    }
+    for (room = lobby->rooms; room != NULL; room = room->next) {
+        for (player = room->game.head; player != NULL; player = player->next) {
+            if (strcmp(player->name, name) == 0) {
+                output_text(lobby->out, fd, "Please enter a not used username");
+                return 1;
+            }
+        }
+    }
+    // Lines that start with '/' are commands
+    if (name[0] == '\0' || name[0] == '/' || strlen(name) >= MAX_NAME) {
+        output_text(lobby->out, fd, "Please enter a valid username");
+        return 1;
+    }
+    return 0;
+}
+
+// Handle a name from a client who has not joined a game yet
+void handle_name(struct lobby *lobby, struct client *p, char *name) {
+    int cur_fd = p->fd;
+    if (read_username(name, lobby, cur_fd) == 0) {
+        game_log("[%d] Read %d bytes\n", cur_fd, (int)strlen(name) + 2);
+        game_log("[%d] newline %s\n", cur_fd, name);
+        remove_new_player(&(lobby->new_players), cur_fd);
+        strcpy(p->name, name);
+        board_insert(&(lobby->board), p);
+        queue_push(lobby, p);
+        game_log("%s is waiting for a seat (%d waiting)\n", name, lobby->queue_depth);
+    } else {
+        output_text(lobby->out, cur_fd, "\r\n");
+    }
+}
+
+/* Answer a command from a player who has a name:
+ *    /top [n]   the n best players (TOP_MAX if n is not given)
+ *    /rank      where the player is on the leaderboard
+ * The answer goes to the player alone and is worked out from the
+ * leaderboard in O(n log BOARD_SCORES), so it can be answered as the line
+ * is read without holding up the rooms.
+ */
+void handle_command(struct lobby *lobby, struct client *p, char *line) {
+    char reply[MAX_REPLY];
+    struct msgbuf m = {reply, 0, MAX_REPLY - 1};
+    struct leaderboard *board = &(lobby->board);
+
+    if (strncmp(line, "/top", 4) == 0 && (line[4] == '\0' || line[4] == ' ')) {
+        struct client *top[TOP_MAX];
+        int n = (line[4] == ' ') ? strtol(line + 5, NULL, 10) : TOP_MAX;
+        if (n < 1 || n > TOP_MAX) {
+            n = TOP_MAX;
+        }
+        int count = board_top(board, top, n);
+        put_lit(&m, "Top players:\r\n");
+        for (int i = 0; i < count; i++) {
+            put_int(&m, board_rank(board, top[i]));
+            put_lit(&m, ". ");
+            put_str(&m, top[i]->name);
+            put_lit(&m, ": ");
+            put_int(&m, top[i]->score);
+            put_lit(&m, " points, ");
+            put_int(&m, top[i]->wins);
+            put_lit(&m, " wins\r\n");
+        }
+    } else if (strcmp(line, "/rank") == 0) {
+        put_lit(&m, "You are ");
+        put_int(&m, board_rank(board, p));
+        put_lit(&m, " of ");
+        put_int(&m, board->players);
+        put_lit(&m, " players, with ");
+        put_int(&m, p->score);
+        put_lit(&m, " points and ");
+        put_int(&m, p->wins);
+        put_lit(&m, " wins in ");
+        put_int(&m, p->rounds);
+        put_lit(&m, " rounds\r\n");
+    } else {
+        put_lit(&m, "Commands: /top [n], /rank\r\n");
+    }
+    reply[m.len] = '\0';
+    output_text(lobby->out, p->fd, reply);
+}
+
+// Remove a client wherever they are and close their connection
+static void lobby_remove(struct lobby *lobby, struct client *p) {
+    int fd = p->fd;
+
+    lobby->clients[fd] = NULL;
+    lobby->connected--;
+    if (p->state != CLIENT_NEW) {
+        board_remove(&(lobby->board), p);
+    }
+    if (p->state == CLIENT_PLAYING) {
+        struct room *room = p->room;
+        struct game_state *game = use_room(lobby, room);
+        remove_player(game, &(game->head), fd);
+        room->players--;
+        lobby->open_seats++;
+        return;
+    }
+    if (p->state == CLIENT_WAITING) {
+        queue_remove(lobby, p);
+    } else {
+        remove_new_player(&(lobby->new_players), fd);
+    }
+    game_log("Removing client %d %s\n", fd, inet_ntoa(p->ipaddr));
+    output_close(lobby->out, fd);
+    free(p->inbuf);
+    free(p);
+}
+
+/* Give one event to the lobby, which passes events from seated players on
+ * to their room. What the game wants done about it is added to out (which
+ * the caller empties with output_reset); the return value is the number of
+ * outputs in out.
+ */
+int lobby_apply(struct lobby *lobby, struct game_event *ev, struct output_list *out) {
+    struct client *p = lobby_client(lobby, ev->fd);
+
+    lobby->out = out;
+    lobby->now_ms = ev->ms;
+    if (ev->type == EV_JOIN) {
+        if (ev->fd < 0 || ev->fd >= MAX_CLIENTS || p != NULL) {
+            fprintf(stderr, "Can't add client %d\n", ev->fd);
+            output_close(out, ev->fd);
+            return out->count;
+        }
+        add_player(&(lobby->new_players), ev->fd, ev->addr, lobby->buf_size);
+        lobby->clients[ev->fd] = lobby->new_players;
+        lobby->connected++;
+        output_text(out, ev->fd, WELCOME_MSG);
+    } else if (ev->type == EV_LINE && p != NULL) {
+        if (p->state == CLIENT_NEW) {
+            handle_name(lobby, p, ev->text);
+        } else if (ev->text[0] == '/') {
+            handle_command(lobby, p, ev->text);
+        } else if (p->state == CLIENT_WAITING) {
+            output_text(out, ev->fd, WAIT_MSG);
+        } else {
+            use_room(lobby, p->room);
+            game_apply(p->room, ev, out);
+        }
+    } else if (ev->type == EV_LEAVE && p != NULL) {
+        lobby_remove(lobby, p);
+    } else if (ev->type == EV_TICK) {
+        lobby_match(lobby);
+        // Only the rooms that changed have anything to send
+        struct room *room = lobby->dirty;
+        lobby->dirty = NULL;
+        while (room != NULL) {
+            struct room *next = room->dirty_next;
+            room->dirty = 0;
+            if (room->players == 0) {
+                room_free(lobby, room);
+            } else {
+                game_apply(room, ev, out);
+            }
+            room = next;
+        }
+    }
+    lobby->out = NULL;
+    return out->count;
+}
@@ -0,0 +1,68 @@
+#ifndef _LOBBY_H_
+#define _LOBBY_H_
+
+#include <stdio.h>
+#include <sys/select.h>
+
+#include "gameplay.h"
+#include "leaderboard.h"
+
+/* Matchmaking. Named players wait in a FIFO and are seated in rooms in the
+ * order they named themselves. A room starts when there are enough players
+ * waiting to fill it, and nobody waits longer than MAX_WAIT_MS: then a
+ * smaller room is started for everyone who is waiting.
+ */
+#define ROOM_SIZE 4             // Players seated in a room
+#define MAX_WAIT_MS 200         // Longest wait for a seat before a smaller room starts
+#define MAX_CLIENTS FD_SETSIZE  // Clients are looked up by socket descriptor
+#define WAIT_BUCKETS 8          // Buckets in the histogram of wait times
+#define MAX_REPLY (TOP_MAX * (MAX_NAME + 48) + MAX_MSG)  // Longest answer to a command
+
+struct match_stats {
+    long seated;                // Players given a seat
+    long wait_total_ms;
+    long wait_max_ms;
+    long waits[WAIT_BUCKETS];   // Seated players by how long they waited
+    int depth_max;              // Most players waiting at once
+    long rooms_started;
+    long rooms_small;           // Rooms started with fewer than room_size players
+};
+
+struct lobby {
+    struct client *new_players;     // Connected, but no name yet
+    struct client *queue_head;      // Named and waiting for a seat, oldest first
+    struct client *queue_tail;
+    int queue_depth;
+    struct room *rooms;
+    int open_seats;                 // Seats free in the rooms that are running
+    int next_room_id;
+    struct room *dirty;             // Rooms with something to flush at the tick
+    struct leaderboard board;       // Every player with a name, by score
+    struct client *clients[MAX_CLIENTS];
+
+    struct dictionary dict;         // Shared by all rooms
+    char *dict_name;
+    int room_size;
+    long max_wait_ms;
+    int max_guesses;
+    int buf_size;                   // Size of each client's input buffer
+    int connected;                  // Clients with a connection open
+
+    long now_ms;                    // Time of the event being handled
+    struct output_list *out;        // Where output goes while lobby_apply runs
+    struct match_stats stats;
+};
+
+void lobby_init(struct lobby *lobby, char *dict_name);
+void lobby_free(struct lobby *lobby);
+struct room *room_create(struct lobby *lobby);
+int lobby_apply(struct lobby *lobby, struct game_event *ev, struct output_list *out);
+struct client *lobby_client(struct lobby *lobby, int fd);
+void lobby_match(struct lobby *lobby);
+long lobby_timeout(struct lobby *lobby, long now);
+void lobby_report(struct lobby *lobby, FILE *fp);
+int read_username(char *name, struct lobby *lobby, int fd);
+void handle_name(struct lobby *lobby, struct client *p, char *name);
+void handle_command(struct lobby *lobby, struct client *p, char *line);
+
+#endif
@@ -0,0 +1,86 @@
+#include <stdint.h>
+#include <time.h>
+
+#include "ratelimit.h"
+
+// One entry of the per-address table
+struct ip_entry {
+    in_addr_t addr;
+    int used;
+    struct bucket bucket;
+};
+
+/* Buckets for the source addresses seen recently. The table is fixed in
+ * size; when the probe window for an address is full the entry that was
+ * refilled least recently is given to the new address.
+ */
+static struct ip_entry ip_table[IP_SLOTS];
+
+/* Return a millisecond clock that is not affected by changes to the
+ * time of day.
+ */
+long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+// Same clock in nanoseconds, for timing
+long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+void bucket_init(struct bucket *b, int burst, long now) {
+    b->tokens = burst * 1000L;
+    b->last_ms = now;
+}
+
+/* Refill the bucket for the time since it was last used and take one
+ * token from it. Return 1 if there was a token to take and 0 otherwise.
+ */
+int bucket_take(struct bucket *b, int rate, int burst, long now) {
+    b->tokens += (now - b->last_ms) * rate;
+    if (b->tokens > burst * 1000L) {
+        b->tokens = burst * 1000L;
+    }
+    b->last_ms = now;
+    if (b->tokens < 1000) {
+        return 0;
+    }
+    b->tokens -= 1000;
+    return 1;
+}
+
+// Find the table entry for addr, claiming one if the address is new
+static struct ip_entry *ip_lookup(in_addr_t addr, long now) {
+    unsigned int h = ((uint32_t)addr * 2654435761u) & (IP_SLOTS - 1);
+    struct ip_entry *oldest = NULL;
+
+    for (int i = 0; i < IP_PROBE; i++) {
+        struct ip_entry *e = &ip_table[(h + i) & (IP_SLOTS - 1)];
+        if (e->used && e->addr == addr) {
+            return e;
+        }
+        if (!e->used) {
+            oldest = e;
+            break;
+        }
+        if (oldest == NULL || e->bucket.last_ms < oldest->bucket.last_ms) {
+            oldest = e;
+        }
+    }
+    oldest->used = 1;
+    oldest->addr = addr;
+    bucket_init(&oldest->bucket, IP_BURST, now);
+    return oldest;
+}
+
+/* Charge one unit of work (a connection or a line) to the source address.
+ * Return 1 if the address is within its budget and 0 otherwise.
+ */
+int ip_allow(struct in_addr addr, long now) {
+    struct ip_entry *e = ip_lookup(addr.s_addr, now);
+    return bucket_take(&e->bucket, IP_RATE, IP_BURST, now);
+}
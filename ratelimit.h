@@ -0,0 +1,28 @@
+#ifndef _RATELIMIT_H_
+#define _RATELIMIT_H_
+
+#include <netinet/in.h>
+
+#define CLIENT_RATE 5       // Lines per second one connection may send
+#define CLIENT_BURST 10     // Lines one connection may send at once
+#define IP_RATE 20          // Lines and connections per second from one address
+#define IP_BURST 40
+#define ABUSE_STRIKES 20    // Dropped lines before a connection is closed
+#define STRIKE_DECAY_MS 1000  // One strike wears off for each second after the last
+#define IP_SLOTS 1024       // Size of the per-address table (a power of 2)
+#define IP_PROBE 8          // Slots looked at before an old entry is reused
+
+// A token bucket. Tokens are kept in thousandths so that refilling
+// at a few tokens per second works with whole milliseconds.
+struct bucket {
+    long tokens;
+    long last_ms;
+};
+
+long now_ms(void);
+long now_ns(void);
+void bucket_init(struct bucket *b, int burst, long now);
+int bucket_take(struct bucket *b, int rate, int burst, long now);
+int ip_allow(struct in_addr addr, long now);
+
+#endif
@@ -0,0 +1,36 @@
+#include <string.h>
+
+#include "render.h"
+
+void put_bytes(struct msgbuf *m, const char *s, int n) {
+    if (n > m->size - m->len) {
+        n = m->size - m->len;
+    }
+    memcpy(m->buf + m->len, s, n);
+    m->len += n;
+}
+
+void put_str(struct msgbuf *m, const char *s) {
+    put_bytes(m, s, strlen(s));
+}
+
+void put_char(struct msgbuf *m, char c) {
+    if (m->len < m->size) {
+        m->buf[m->len++] = c;
+    }
+}
+
+// Add n in decimal
+void put_int(struct msgbuf *m, int n) {
+    char digits[12];
+    int i = sizeof(digits);
+    unsigned int u = (n < 0) ? -(unsigned int)n : (unsigned int)n;
+    do {
+        digits[--i] = '0' + u % 10;
+        u /= 10;
+    } while (u != 0);
+    if (n < 0) {
+        digits[--i] = '-';
+    }
+    put_bytes(m, digits + i, sizeof(digits) - i);
+}
@@ -0,0 +1,35 @@
+#ifndef _RENDER_H_
+#define _RENDER_H_
+
+/* Messages are rendered into a buffer given by the caller. len is how much
+ * of the buffer has been used. Bytes that would go past size are dropped,
+ * so a message can never overrun its buffer.
+ */
+struct msgbuf {
+    char *buf;
+    int len;
+    int size;
+};
+
+// Add a string literal; its length is known when compiling
+#define put_lit(m, lit) put_bytes((m), (lit), sizeof(lit) - 1)
+
+void put_bytes(struct msgbuf *m, const char *s, int n);
+void put_str(struct msgbuf *m, const char *s);
+void put_char(struct msgbuf *m, char c);
+void put_int(struct msgbuf *m, int n);
+
+// The fixed parts of the messages the game sends
+#define STATUS_HEAD "***************\r\nWord to guess: "
+#define STATUS_GUESSES "\r\nGuesses remaining: "
+#define STATUS_LETTERS "\r\nLetters guessed: \r\n"
+#define STATUS_TAIL "\r\n***************\r\n"
+#define YOUR_TURN "Your guess?\r\n"
+#define TURN_HEAD "It's "
+#define TURN_TAIL "'s turn\r\n"
+#define YOU_WIN "Game over! You win!\n\n\nLet's start a new game\r\n"
+#define WINNER_HEAD "Game over! "
+#define WINNER_TAIL " won!\n\n\nLet's start a new game\r\n"
+#define NO_GUESSES "\nNo guesses left. Game over.\n\nLet's start a new game\r\n"
+
+#endif
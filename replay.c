@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+
+#include "gameplay.h"
+#include "lobby.h"
+#include "journal.h"
+
+/* wordreplay feeds a journal recorded by "wordsrv -r" through the game
+ * without any sockets. The same seed and dictionary give the same words,
+ * so the run ends in the same state and sends the same messages. It
+ * prints a digest of everything that would have been sent (compare it
+ * between builds to catch changes in behaviour) and how long the game
+ * took to handle the input, and the matchmaking numbers for the run.
+ */
+
+// What would have been sent to the clients
+unsigned long out_bytes = 0;
+unsigned long out_messages = 0;
+unsigned int out_digest = 2166136261u;  // FNV-1a over fd and message
+
+// Add what the game asked to send to the digest instead of sending it
+void take_output(struct output_list *out, int verbose) {
+    for (int i = 0; i < out->count; i++) {
+        struct game_output *o = &out->items[i];
+        const char *msg = out->text + o->start;
+        if (o->type != OUT_SEND) {
+            continue;
+        }
+        unsigned char fd_bytes[2] = {o->fd & 0xff, (o->fd >> 8) & 0xff};
+        for (int k = 0; k < 2; k++) {
+            out_digest = (out_digest ^ fd_bytes[k]) * 16777619u;
+        }
+        for (int k = 0; k < o->len; k++) {
+            out_digest = (out_digest ^ (unsigned char)msg[k]) * 16777619u;
+        }
+        out_bytes += o->len;
+        out_messages++;
+        if (verbose) {
+            printf("[%d] >> %.*s", o->fd, o->len, msg);
+        }
+    }
+    output_reset(out);
+}
+
+int main(int argc, char **argv) {
+    struct journal_record r;
+    struct journal_header h;
+    long records = 0, lines = 0, last_ms = 0;
+    int verbose = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "v")) != -1) {
+        if (opt == 'v') {
+            verbose = 1;
+        } else {
+            optind = argc;
+            break;
+        }
+    }
+    if (argc - optind != 2) {
+        fprintf(stderr, "Usage: %s [-v] <dictionary filename> <journal>\n", argv[0]);
+        exit(1);
+    }
+    char *dict_name = argv[optind];
+    FILE *fp = journal_open(argv[optind + 1], &h);
+
+    static struct lobby lobby;
+    struct output_list out;
+    struct game_event ev;
+
+    // The game logs what it does to stdout; only keep that when asked
+    game_verbose = verbose;
+    srandom(h.seed);
+    lobby_init(&lobby, dict_name);
+    lobby.max_guesses = h.max_guesses;
+    lobby.room_size = h.room_size;
+    lobby.max_wait_ms = h.max_wait_ms;
+    output_init(&out);
+    if (lobby.dict.size != h.dict_size) {
+        fprintf(stderr, "The journal was recorded with a dictionary of %d words, not %d\n",
+            h.dict_size, lobby.dict.size);
+        exit(1);
+    }
+
+    long start = now_ns();
+    while (journal_read(fp, &r)) {
+        records++;
+        last_ms = r.ms;
+        // Records hold the events the server gave to the game
+        ev.type = r.kind;
+        ev.fd = r.fd;
+        ev.text = r.data;
+        ev.ms = r.ms;
+        memset(&(ev.addr), 0, sizeof(ev.addr));
+        if (r.kind == J_CONNECT && r.len == sizeof(ev.addr)) {
+            memcpy(&(ev.addr), r.data, sizeof(ev.addr));
+        } else if (r.kind == J_LINE) {
+            lines++;
+        }
+        lobby_apply(&lobby, &ev, &out);
+        take_output(&out, verbose);
+    }
+    long elapsed = now_ns() - start;
+
+    printf("records: %ld over %ld ms recorded\n", records, last_ms);
+    printf("lines: %ld\n", lines);
+    printf("sent: %lu messages, %lu bytes\n", out_messages, out_bytes);
+    printf("digest: %08x\n", out_digest);
+    for (struct room *room = lobby.rooms; room != NULL; room = room->next) {
+        printf("room %d: %s (%s), %d players\n", room->id, room->game.word,
+            room->game.guess, room->players);
+    }
+    printf("time: %ld ns, %.1f ns/line, %.0f lines/sec\n", elapsed,
+        lines ? (double)elapsed / lines : 0.0,
+        elapsed ? lines * 1e9 / elapsed : 0.0);
+    lobby_report(&lobby, stdout);
+    lobby_free(&lobby);
+    output_free(&out);
+    fclose(fp);
+    return 0;
+}
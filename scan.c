@@ -0,0 +1,174 @@
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86
+#endif
+
+static int newline_scalar(const char *buf, int n) {
+    for (int i = 0; i < n; i++) {
+        if (buf[i] == '\n') {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void lower_scalar(char *buf, int n) {
+    for (int i = 0; i < n; i++) {
+        if ((unsigned char)(buf[i] - 'A') < 26) {
+            buf[i] += 'a' - 'A';
+        }
+    }
+}
+
+static int letters_scalar(const char *buf, int n) {
+    int i = 0;
+    while (i < n && (unsigned char)(buf[i] - 'a') < 26) {
+        i++;
+    }
+    return i;
+}
+
+#ifdef SCAN_X86
+/* The vector versions work on 16 or 32 bytes at a time and leave the
+ * remaining bytes to the scalar version. A byte is in the range [lo, lo+26)
+ * when, after adding 128 - lo, it is less than -128 + 26 as a signed byte.
+ */
+__attribute__((target("sse2")))
+static int newline_sse2(const char *buf, int n) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    int k = newline_scalar(buf + i, n - i);
+    return (k < 0) ? -1 : i + k;
+}
+
+__attribute__((target("sse2")))
+static void lower_sse2(char *buf, int n) {
+    const __m128i shift = _mm_set1_epi8(128 - 'A');
+    const __m128i limit = _mm_set1_epi8(-128 + 26);
+    const __m128i bit = _mm_set1_epi8('a' - 'A');
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+        __m128i upper = _mm_cmpgt_epi8(limit, _mm_add_epi8(v, shift));
+        v = _mm_or_si128(v, _mm_and_si128(upper, bit));
+        _mm_storeu_si128((__m128i *)(buf + i), v);
+    }
+    lower_scalar(buf + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static int letters_sse2(const char *buf, int n) {
+    const __m128i shift = _mm_set1_epi8(128 - 'a');
+    const __m128i limit = _mm_set1_epi8(-128 + 26);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+        int mask = _mm_movemask_epi8(_mm_cmpgt_epi8(limit, _mm_add_epi8(v, shift)));
+        if (mask != 0xffff) {
+            return i + __builtin_ctz(~mask);
+        }
+    }
+    return i + letters_scalar(buf + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static int newline_avx2(const char *buf, int n) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(buf + i));
+        unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    int k = newline_sse2(buf + i, n - i);
+    return (k < 0) ? -1 : i + k;
+}
+
+__attribute__((target("avx2")))
+static void lower_avx2(char *buf, int n) {
+    const __m256i shift = _mm256_set1_epi8(128 - 'A');
+    const __m256i limit = _mm256_set1_epi8(-128 + 26);
+    const __m256i bit = _mm256_set1_epi8('a' - 'A');
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(buf + i));
+        __m256i upper = _mm256_cmpgt_epi8(limit, _mm256_add_epi8(v, shift));
+        v = _mm256_or_si256(v, _mm256_and_si256(upper, bit));
+        _mm256_storeu_si256((__m256i *)(buf + i), v);
+    }
+    lower_sse2(buf + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static int letters_avx2(const char *buf, int n) {
+    const __m256i shift = _mm256_set1_epi8(128 - 'a');
+    const __m256i limit = _mm256_set1_epi8(-128 + 26);
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(buf + i));
+        unsigned int mask = _mm256_movemask_epi8(_mm256_cmpgt_epi8(limit, _mm256_add_epi8(v, shift)));
+        if (mask != 0xffffffffu) {
+            return i + __builtin_ctz(~mask);
+        }
+    }
+    return i + letters_sse2(buf + i, n - i);
+}
+#endif
+
+/* Until a level has been chosen these pick the default one and pass the
+ * call on to it.
+ */
+static int newline_first(const char *buf, int n) {
+    scan_use(SCAN_DEFAULT);
+    return scan_newline(buf, n);
+}
+
+static void lower_first(char *buf, int n) {
+    scan_use(SCAN_DEFAULT);
+    scan_lower(buf, n);
+}
+
+static int letters_first(const char *buf, int n) {
+    scan_use(SCAN_DEFAULT);
+    return scan_letters(buf, n);
+}
+
+int (*scan_newline)(const char *buf, int n) = newline_first;
+void (*scan_lower)(char *buf, int n) = lower_first;
+int (*scan_letters)(const char *buf, int n) = letters_first;
+
+/* Use the given level of scanning, or the best one below it that this CPU
+ * supports. Return the level in use.
+ */
+int scan_use(int level) {
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (level >= SCAN_AVX2 && __builtin_cpu_supports("avx2")) {
+        scan_newline = newline_avx2;
+        scan_lower = lower_avx2;
+        scan_letters = letters_avx2;
+        return SCAN_AVX2;
+    }
+    if (level >= SCAN_SSE2 && __builtin_cpu_supports("sse2")) {
+        scan_newline = newline_sse2;
+        scan_lower = lower_sse2;
+        scan_letters = letters_sse2;
+        return SCAN_SSE2;
+    }
+#endif
+    scan_newline = newline_scalar;
+    scan_lower = lower_scalar;
+    scan_letters = letters_scalar;
+    return SCAN_SCALAR;
+}
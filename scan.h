@@ -0,0 +1,26 @@
+#ifndef _SCAN_H_
+#define _SCAN_H_
+
+/* Scanning of whole input buffers. Each operation has a scalar version and
+ * SSE2 and AVX2 versions on x86. Unless scan_use is called first, the first
+ * call picks SCAN_DEFAULT, or the best level below it that the CPU supports.
+ */
+#define SCAN_SCALAR 0
+#define SCAN_SSE2 1
+#define SCAN_AVX2 2
+
+// Input lines are short, and on those wordbench has SSE2 ahead of AVX2 at
+// every buffer size (a whole line fits in one 16 byte block), so AVX2 is
+// only used when asked for
+#define SCAN_DEFAULT SCAN_SSE2
+
+// Return the index of the first '\n' in buf, or -1 if there is none
+extern int (*scan_newline)(const char *buf, int n);
+// Change the upper case ASCII letters in buf to lower case
+extern void (*scan_lower)(char *buf, int n);
+// Return how many of the bytes at the start of buf are letters 'a' to 'z'
+extern int (*scan_letters)(const char *buf, int n);
+
+int scan_use(int level);
+
+#endif
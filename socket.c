@@ -71,22 +71,21 @@ int set_up_server_socket(struct sockaddr_in *self, int num_queue) {
 /*
  * Wait for and accept a new connection.
  * Terminate with exit code 1 if the accept call failed, otherwise return
- * the client's socket descriptor.
+ * the client's socket descriptor. The client's address is stored in peer.
  */
-int accept_connection(int listenfd) {
-    struct sockaddr_in peer;
-    unsigned int peer_len = sizeof(peer);
-    peer.sin_family = PF_INET;
+int accept_connection(int listenfd, struct sockaddr_in *peer) {
+    unsigned int peer_len = sizeof(*peer);
+    peer->sin_family = PF_INET;
 
     printf("Waiting for a new connection...\n");
-    int client_socket = accept(listenfd, (struct sockaddr *)&peer, &peer_len);
+    int client_socket = accept(listenfd, (struct sockaddr *)peer, &peer_len);
     if (client_socket < 0) {
         perror("accept");
         exit(1);
     } else {
         printf("New connection accepted from %s:%d\n",
-            inet_ntoa(peer.sin_addr),
-            ntohs(peer.sin_port));
+            inet_ntoa(peer->sin_addr),
+            ntohs(peer->sin_port));
         return client_socket;
     }
 }
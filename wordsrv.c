@@ -11,412 +11,215 @@
 #include <errno.h>
 #include <time.h>
 #include <signal.h>
+#include <fcntl.h>
 
 #include "socket.h"
+#include "config.h"
 #include "gameplay.h"
+#include "lobby.h"
+#include "journal.h"
+#include "scan.h"
 
 
-#ifndef PORT
-    #define PORT 53744
-#endif
-#define MAX_QUEUE 5
-
-
-void add_player(struct client **top, int fd, struct in_addr addr);
-void remove_player(struct game_state *game, struct client **top, int fd);
-
-/* These are some of the function prototypes that we used in our solution 
- * You are not required to write functions that match these prototypes, but
- * you may find the helpful when thinking about operations in your program.
- */
-/* Send the message in outbuf to all clients */
-void broadcast(struct game_state *game, char *outbuf, char* name);
-int check_play(struct client **top, int fd);
-void announce_turn(struct game_state *game);
-void announce_winner(struct game_state *game, struct client *winner);
-/* Move the has_next_turn pointer to the next active client */
-void advance_turn(struct game_state *game);
-/* The following are helpers */
-int find_network_newline(const char *buf, int n);
-int check_read(struct game_state *game, int fd, char *buf, int room);
-int guess_word(struct game_state *game, int fd, char *guess,  char *username);
-int update(struct game_state *game, char *guess);
-int check_over(struct game_state *game);
-int read_username(char *name, struct game_state *game, int fd);
-void remove_new_player(struct client **top, int fd);
-void add_new_player(struct client **top, int fd, char *name);
-void move_to_game(struct client **new_players, int fd, struct game_state *game, char *name);
-int is_over(struct game_state *game);
-int valid_guess_char(char guess);
-int valid_guess_guessed(struct game_state *game, char guess);
+/* Helpers for reading lines from clients */
+int check_read(struct client *p);
+char *next_line(struct client *p, int *start);
+void drop_lines(struct client *p, int start);
+int allow_line(struct client *p, long now);
+void drop_client(struct lobby *lobby, int fd);
+void drop_idle(struct lobby *lobby, struct config *cfg, int maxfd, long now);
+void run_event(struct lobby *lobby, struct game_event *ev);
 
 
 /* The set of socket descriptors for select to monitor.
  * This is a global variable because we need to remove socket descriptors
- * from allset when a write to a socket fails.
+ * from allset when the game drops a client.
  */
 fd_set allset;
 
-// Check if a player exists according to where they are placed
-int check_play(struct client **top, int fd) {
-    struct client *p;
-    int exist = 0;
-    for (p = *top; p != NULL; p = p->next) {
-        if (p->fd == fd) {
-            exist = 1;
-            break;
-        }
-    }
-    return exist;
-}
+// What the game asked for while handling the current event
+struct output_list out;
 
-/* Add a client to the head of the linked list
- */
-void add_player(struct client **top, int fd, struct in_addr addr) {
-    struct client *p = malloc(sizeof(struct client));
-
-    if (!p) {
-        perror("malloc");
-        exit(1);
-    }
+// The journal that input is recorded to (NULL unless the server was started with -r)
+FILE *journal = NULL;
 
-    printf("Adding client %s\n", inet_ntoa(addr));
+// When the server started; events, budgets and timeouts are timed from here
+long server_start;
 
-    p->fd = fd;
-    p->ipaddr = addr;
-    p->name[0] = '\0';
-    p->in_ptr = p->inbuf;
-    p->inbuf[0] = '\0';
-    p->next = *top;
-    *top = p;
+// Return the number of ms since the server started
+long server_ms(void) {
+    return now_ms() - server_start;
 }
 
-/* Removes client from the linked list and closes its socket.
- * Also removes socket descriptor from allset 
- */
-void remove_player(struct game_state *game, struct client **top, int fd) {
-    struct client **p;
-
-    for (p = top; *p && (*p)->fd != fd; p = &(*p)->next)
-    ;
-    // Now, p points to (1) top, or (2) a pointer to another client
-    // This avoids a special case for removing the head of the list
-    if (*p) {
-        struct client *t = (*p)->next;
-        printf("Disconnect from %s\n", inet_ntoa((*p)->ipaddr));
-        printf("Removing client %d %s\n", fd, inet_ntoa((*p)->ipaddr));
-
-        // If remove is called to remove a named player
-        // if (strcmp(instruction, "no name player") != 0) { // Not removing un-named player
-        if ((*p)->name == NULL){
-            char bye_message[MAX_MSG];
-            strcpy(bye_message, "Goodbye ");
-            strcat(bye_message, (*p)->name);
-            strcat(bye_message, "\r\n");
-            broadcast(game, bye_message, (*p)->name);
-        }
+// Set by SIGUSR1 to ask for the matchmaking numbers
+volatile sig_atomic_t report_wanted = 0;
 
-        FD_CLR((*p)->fd, &allset);
-        close((*p)->fd);
-        free(*p);
-        *p = t;
-        if (game->has_next_turn != NULL && game->head == NULL) {
-            game->has_next_turn = NULL;
-        } 
-    } else {
-        fprintf(stderr, "Trying to remove fd %d, but I don't know about it\n", fd);
-    }
+void ask_report(int sig) {
+    report_wanted = 1;
 }
 
-// Removes a new player from new player list, helper for move_to_game
-void remove_new_player(struct client **top, int fd) {
-    struct client **p;
-    for (p = top; *p && (*p)->fd != fd; p = &(*p)->next);
-    if (*p) {
-        struct client *t = (*p)->next;
-        printf("Removing client %d from new players\n", fd);
-        *p = t;
-    }
-}
-
-// Add a client with name to the game head, helper for move_to_game
-void add_new_player(struct client **top, int fd, char *name) {
-    struct client *p = malloc(sizeof(struct client));
-
-    if (!p) {
-        perror("malloc");
-        exit(1);
-    }
-
-    printf("Adding client %s\n", name);
-
-    p->fd = fd;
-    strcpy(p->name, name);
-    p->in_ptr = p->inbuf;
-    p->inbuf[0] = '\0';
-    p->next = *top;
-    *top = p;
-}
-
-
-
-// Write message to all active players
-void broadcast(struct game_state *game, char *outbuf, char* name) {
-    struct client *p;
-    p = game->head;
-    while ( p != NULL) {
-        if (strcmp(p->name, name) != 0) { 
-            if (dprintf(p->fd, "%s", outbuf)< 0) {
-                remove_player(game ,&(game->head), p->fd);
-            }
+/* Record the event if we are recording, give it to the game and carry out
+ * what the game asks for. Clients whose sockets can't be written to are
+ * dropped afterwards by giving the game a leave event for each of them.
+ * Client sockets don't block, so a client that doesn't read what it is sent
+ * fills its socket buffer and is dropped instead of stalling every room.
+ */
+void run_event(struct lobby *lobby, struct game_event *ev) {
+    fd_set failed;
+    int max_failed = -1;
+
+    long ms = server_ms();
+    ev->ms = ms;
+    if (journal != NULL) {
+        if (ev->type == EV_JOIN) {
+            journal_write(journal, ms, J_CONNECT, ev->fd, &(ev->addr), sizeof(ev->addr));
+        } else if (ev->type == EV_LINE) {
+            journal_write(journal, ms, J_LINE, ev->fd, ev->text, strlen(ev->text));
+        } else {
+            journal_write(journal, ms, ev->type, ev->fd, NULL, 0);
         }
-        p = p->next;
     }
-}
 
-// Tell all palyer that it is which player's turn to play.
-void announce_turn(struct game_state *game) {
-    struct client *p;
-    p = game->head;
-    while (p != NULL) {
-        if ((game->has_next_turn)->fd == p->fd) { 
-            if (dprintf(p->fd, "Your guess?\r\n") < 0) { 
-                remove_player(game, &(game->head), p->fd);
-            }
-        } else { 
-            if (dprintf(p->fd, "It's %s's turn\r\n", (game->has_next_turn)->name) < 0) {
-                remove_player(game, &(game->head), p->fd);
-            }
+    FD_ZERO(&failed);
+    lobby_apply(lobby, ev, &out);
+    for (int i = 0; i < out.count; i++) {
+        struct game_output *o = &out.items[i];
+        if (!FD_ISSET(o->fd, &allset)) {
+            continue;
         }
-        p = p->next;
-    }
-}
-
-// Announce winner's name to playing players.
-void announce_winner(struct game_state *game, struct client *winner) {
-    struct client *p;
-    p = game->head;
-    while (p != NULL) {
-        if (strcmp(p->name, winner->name) == 0) { 
-            if (dprintf(p->fd, "Game over! You win!\n\n\nLet's start a new game\r\n") < 0) { 
-                remove_player(game, &(game->head), p->fd);
-            }
+        if (o->type == OUT_CLOSE) {
+            FD_CLR(o->fd, &allset);
+            FD_CLR(o->fd, &failed);
+            close(o->fd);
+        } else if (FD_ISSET(o->fd, &failed)) {
+            continue;
         } else {
-            if (dprintf(p->fd, "Game over! %s won!\n\n\nLet's start a new game\r\n", winner->name) < 0) { 
-                remove_player(game, &(game->head), p->fd);
+            int written = write(o->fd, out.text + o->start, o->len);
+            if (written == o->len) {
+                continue;
+            }
+            if (written >= 0 || errno == EAGAIN || errno == EWOULDBLOCK) {
+                printf("Closing %d: not reading its output\n", o->fd);
+            }
+            FD_SET(o->fd, &failed);
+            if (o->fd > max_failed) {
+                max_failed = o->fd;
             }
         }
-        p = p->next;
     }
-}
+    output_reset(&out);
 
-// Change the has_next_turn pointer to the next active player
-void advance_turn(struct game_state *game) {
-    if ((game->has_next_turn)->next != NULL) {
-        game->has_next_turn = game->has_next_turn->next;
-    } else {
-        game->has_next_turn = game->head;
-    }
-}
-// Helper for removing a client from new palyer list to game list
-void move_to_game(struct client **new_players, int fd, struct game_state *game, char *name) {
-    struct client *p;
-    p = *new_players;
-    while (p != NULL) {
-        if (p->fd == fd) {
-            remove_new_player(new_players, fd);
-            break;
+    for (int fd = 0; fd <= max_failed; fd++) {
+        if (FD_ISSET(fd, &failed)) {
+            struct game_event leave = {EV_LEAVE, fd};
+            run_event(lobby, &leave);
         }
-        p = p->next;
     }
-    if (game->head == NULL) {
-        add_new_player(&(game->head), fd, name);
-        game->has_next_turn = p;
-        game->has_next_turn = game->head;
-    } else { 
-        add_new_player(&(game->head), fd, name);
+
+    // Clients dropped while a tick was being sent leave their rooms with
+    // updates (such as whose turn it is) that would otherwise wait until
+    // some other input arrives. Send them now.
+    if (ev->type == EV_TICK && lobby->dirty != NULL) {
+        struct game_event tick = {EV_TICK, 0};
+        run_event(lobby, &tick);
     }
 }
 
-// Helper from lab10 to help read
-int find_network_newline(const char *buf, int n) {
-    for (int k = 0; k < n; k++) {
-        if (buf[k] == '\n') {
-            return k + 1;
-        }
-    }
-    return -1;
+// Tell the game that a client has gone or is being dropped
+void drop_client(struct lobby *lobby, int fd) {
+    struct game_event leave = {EV_LEAVE, fd};
+    run_event(lobby, &leave);
 }
 
-// Helper for guess_word and read_username,checking if there is any erroe for read
-int check_read(struct game_state *game, int fd, char *buf, int room) {
-    int num_read = read(fd, buf, room);
-    int exist;
-    if (num_read == 0) { 
-        exist = check_play(&(game->head), fd);
-        if (exist == 1) {
-            remove_player(game, &(game->head), fd);
+/* Drop the clients that have not sent a name within the name timeout of
+ * connecting, or have sent nothing at all for the idle timeout, so that
+ * they don't hold on to a place under max_clients.
+ */
+void drop_idle(struct lobby *lobby, struct config *cfg, int maxfd, long now) {
+    for (int fd = 0; fd <= maxfd; fd++) {
+        struct client *p = lobby_client(lobby, fd);
+        if (p == NULL) {
+            continue;
+        }
+        if (cfg->name_timeout_ms > 0 && p->state == CLIENT_NEW &&
+                now - p->joined_ms >= cfg->name_timeout_ms) {
+            printf("Closing %d: no name\n", fd);
+            drop_client(lobby, fd);
+        } else if (cfg->idle_timeout_ms > 0 && now - p->last_ms >= cfg->idle_timeout_ms) {
+            printf("Closing %d: idle\n", fd);
+            drop_client(lobby, fd);
         }
-    } else if (num_read < 0) {
-        perror("read");
-        exit(1);
     }
-    return num_read;
 }
 
-//helper to see if input is a valid letter
-int valid_guess_char(char guess){
-    if (guess =='a' || guess =='b' || guess =='c' || guess =='d' || guess =='e' ||
-    guess =='f' || guess =='g' || guess =='h' || guess =='i' || guess =='j' || guess =='k' ||
-    guess =='l' || guess =='m' || guess =='n' || guess =='o' || guess =='p' || guess =='q' || 
-    guess =='r' || guess =='s' || guess =='t' || guess =='u' ||guess =='v' || guess =='w' ||
-    guess =='x' || guess =='y' || guess =='z') {
+/* Read what the client has sent onto the end of its inbuf.
+ * Return the number of bytes read, 0 if the client closed the connection,
+ * the read failed or the client sent a line that does not fit in inbuf,
+ * or -1 if there was nothing to read after all.
+ */
+int check_read(struct client *p) {
+    int room = p->in_size - 1 - (p->in_ptr - p->inbuf);
+    if (room <= 0) {
         return 0;
     }
-    return 1;
-}
-
-// helper to see if the letter has been guessed
-int valid_guess_guessed(struct game_state *game, char guess){
-    int result = 0;
-    if(game->letters_guessed[(int)guess - 97] == 1){
-        result = 1;
+    int num_read = read(p->fd, p->in_ptr, room);
+    if (num_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return -1;
     }
-    return result;
-}
-
-// Read a valid guess from player
-int guess_word(struct game_state *game, int fd, char *guess,  char *name) {
-    int inbuf = 0;           
-    int room = sizeof(guess);  
-    char *after = guess;       
-
-    int nbytes;
-    if ((nbytes = check_read(game, fd, after, room)) > 0) {
-        inbuf += nbytes;
-        int where;
-        if ((where = find_network_newline(guess, inbuf)) > 0) {
-            guess [where - 2] = '\0';
-            inbuf -= where;
-            memmove(guess, &guess[where], inbuf);
-        }
-        after = &guess[inbuf];
-        room = MAX_BUF - inbuf;
-    
-        if (where == -1) {
-            return 1;
-        }
-        if (fd != (game->has_next_turn)->fd) {
-            int num_read = strlen(after) + 2;
-            printf("[%d] Read %d bytes\n", fd, num_read);
-            printf("[%d] newline %c\n", fd, after[0]);
-            printf("Player %s try to guess out of turn\n", name);
-            if (dprintf(fd, "It's not your turn to guess\r\n") < 0) { 
-                remove_player(game, &(game->head), fd);
-            }
-            return 1;
-        }
-        if (valid_guess_char(guess[0]) == 1) {
-            if (dprintf(fd, "Please enter a valid letter\r\n") < 0) { 
-                remove_player(game, &(game->head), fd);
-            }
-            return 1;
-        }else if (where != 3){
-            if (dprintf(fd, "Please enter a single letter\r\n") < 0) {
-                remove_player(game, &(game->head), fd);
-            }
-            return 1;
-        }else if (valid_guess_guessed(game, guess[0]) == 1){
-            if (dprintf(fd, "Please enter a letter that is not guessed\r\n") < 0) { 
-                remove_player(game, &(game->head), fd);
-            }
-            return 1;
-        }
+    if (num_read < 0) {
+        perror("read");
         return 0;
     }
-    return 1;
+    p->in_ptr += num_read;
+    return num_read;
 }
 
-// Update the guessed word
-int update(struct game_state *game, char *guess) {
-    int correct = 1;
-    int current_guess_length = strlen(game->word);
-    for (int i = 0; i < current_guess_length; i++) {
-        if (game->guess[i] == '-' && game->word[i] == *guess) {
-            game->guess[i] = guess[0];
-            correct = 0;
-            game->guesses_left -= 1;
-        }
+/* Return the next complete line in the client's inbuf, starting at *start,
+ * and move *start past it. The network newline is replaced with '\0', so
+ * the line can be used where it is. Return NULL if there is no complete
+ * line. Lines stay in inbuf until drop_lines is called, so a whole read of
+ * pipelined lines is handled with one scan and one move.
+ */
+char *next_line(struct client *p, int *start) {
+    char *line = p->inbuf + *start;
+    int where = scan_newline(line, (p->in_ptr - p->inbuf) - *start);
+    if (where < 0) {
+        return NULL;
     }
-    game->letters_guessed[guess[0] - 97] = 1;
-    return correct;
-}
-
-// helper to check if the game is over
-int is_over(struct game_state *game){
-    if ((strcmp(game->guess ,game->word) == 0) || game->guesses_left == 0 ) {
-        return 0;
+    line[where] = '\0';
+    if (where > 0 && line[where - 1] == '\r') {
+        line[where - 1] = '\0';
     }
-    return 1;
+    *start += where + 1;
+    return line;
 }
 
-// Check if the game must end due to no guessing chance left
-int check_over(struct game_state *game) {
-    char game_over_msg[MAX_MSG];
-    if (is_over(game) == 0) {
-        strcpy(game_over_msg, "The word is ");
-        strcat(game_over_msg, game->word);
-        strcat(game_over_msg, "\n");
-        strcat(game_over_msg, "No guesses left. Game over.\n");
-        strcat(game_over_msg, "\n");
-        strcat(game_over_msg, "Let's start a new game\r\n");
-        broadcast(game, game_over_msg, "all");
-        return 1;
-    }
-    return 0;
+// Remove the lines that have been handled from the front of inbuf
+void drop_lines(struct client *p, int start) {
+    int inbuf = p->in_ptr - p->inbuf;
+    memmove(p->inbuf, &p->inbuf[start], inbuf - start);
+    p->in_ptr -= start;
 }
 
-// Helper for reading name input from stdin
-int read_username(char *name, struct game_state *game, int fd) {
-    int inbuf = 0;           
-    int room = sizeof(name);  
-    char *after = name;       
-
-    int nbytes;
-    if ((nbytes = check_read(game, fd, after, room)) > 0) {
-        inbuf += nbytes;
-        int where;
-        if ((where = find_network_newline(name, inbuf)) > 0) {
-            name [where - 2] = '\0';
-            inbuf -= where;
-            memmove(name, &name[where], inbuf);
-
-        }
-        after = &name[inbuf];
-        room = MAX_NAME - inbuf;
-        if (where == -1) {
-            return 1;
-        }
-        struct client *player;
-        player = game->head;
-        while(player != NULL){
-            if (strcmp(player->name, name) == 0){
-                if (dprintf(fd, "Please enter a not used username") < 0) { // Disconnection
-                    remove_player(game, &(game->head), fd);
-                }
-                return 1;
-            }
-            player = player->next;
-        }
-        if (name[0] == '\0' ){
-            if (dprintf(fd, "Please enter a valid username") < 0) { // Disconnection
-                remove_player(game, &(game->head), fd);
-            }
-            return 1;
-        }
+/* Charge a line to the client's address's budget and then to the client's
+ * own budget. Lines over budget are dropped before they are parsed; return
+ * 0 for those. Only lines over the client's own budget count a strike
+ * against it, so other clients at the same address can't get it closed.
+ * Strikes wear off over time, so a client that goes over budget now and
+ * then is not closed in the end.
+ */
+int allow_line(struct client *p, long now) {
+    if (!ip_allow(p->ipaddr, now)) {
         return 0;
     }
-    return 1;
+    if (bucket_take(&p->limit, CLIENT_RATE, CLIENT_BURST, now)) {
+        return 1;
+    }
+    long forgiven = (now - p->strike_ms) / STRIKE_DECAY_MS;
+    p->strikes = (forgiven >= p->strikes) ? 0 : p->strikes - forgiven;
+    p->strikes++;
+    p->strike_ms = now;
+    return 0;
 }
 
 
@@ -426,38 +229,70 @@ int main(int argc, char **argv) {
     struct client *p;
     struct sockaddr_in q;
     fd_set rset;
-    
-    if(argc != 2){
-        fprintf(stderr,"Usage: %s <dictionary filename>\n", argv[0]);
+    char *journal_name = NULL;
+    struct config cfg;
+    int opt;
+
+    // Settings are applied in the order they are given, so later ones win
+    config_init(&cfg);
+    while ((opt = getopt(argc, argv, "r:c:p:o:")) != -1) {
+        if (opt == 'r') {
+            journal_name = optarg;
+        } else if (opt == 'c') {
+            config_file(&cfg, optarg);
+        } else if (opt == 'p' && config_set(&cfg, "port", optarg) == 0) {
+            continue;
+        } else if (opt == 'o' && config_option(&cfg, optarg) == 0) {
+            continue;
+        } else {
+            optind = argc;
+            break;
+        }
+    }
+    if(argc - optind != 1){
+        fprintf(stderr,"Usage: %s [-r journal] [-c config] [-p port] [-o key=value]... <dictionary filename>\n", argv[0]);
         exit(1);
     }
+    char *dict_name = argv[optind];
     
-    // Create and initialize the game state
-    struct game_state game;
-
-    srandom((unsigned int)time(NULL));
-    // Set up the file pointer outside of init_game because we want to 
-    // just rewind the file when we need to pick a new word
-    game.dict.fp = NULL;
-    game.dict.size = get_file_length(argv[1]);
+    // Create and initialize the game state. The lobby is too big for
+    // the stack, because it looks clients up by socket descriptor.
+    static struct lobby lobby;
+
+    unsigned int seed = (unsigned int)time(NULL);
+    srandom(seed);
+    lobby_init(&lobby, dict_name);
+    lobby.room_size = cfg.room_size;
+    lobby.max_wait_ms = cfg.max_wait_ms;
+    lobby.max_guesses = cfg.max_guesses;
+    lobby.buf_size = cfg.buf_size;
+    output_init(&out);
+    server_start = now_ms();
+
+    cfg.scan = scan_use(cfg.scan);
+    config_print(&cfg, stdout);
+
+    // Record the seed and settings so that a replay plays the same games
+    if (journal_name != NULL) {
+        struct journal_header h = {seed, lobby.dict.size, cfg.max_guesses,
+            cfg.room_size, cfg.max_wait_ms};
+        journal = journal_create(journal_name, &h);
+    }
 
-    init_game(&game, argv[1]);
-    
-    // head and has_next_turn also don't change when a subsequent game is
-    // started so we initialize them here.
-    game.head = NULL;
-    game.has_next_turn = NULL;
-    
-    /* A list of client who have not yet entered their name.  This list is
-     * kept separate from the list of active players in the game, because
-     * until the new playrs have entered a name, they should not have a turn
-     * or receive broadcast messages.  In other words, they can't play until
-     * they have a name.
-     */
-    struct client *new_players = NULL;
+    // kill -USR1 prints the queue depth and wait times. Reads and writes
+    // the signal lands in are restarted, so asking for the report can't
+    // make a client look as if it failed; select still returns early.
+    struct sigaction report;
+    report.sa_handler = ask_report;
+    report.sa_flags = SA_RESTART;
+    sigemptyset(&report.sa_mask);
+    if (sigaction(SIGUSR1, &report, NULL) == -1) {
+        perror("sigaction");
+        exit(1);
+    }
     
-    struct sockaddr_in *server = init_server_addr(PORT);
-    int listenfd = set_up_server_socket(server, MAX_QUEUE);
+    struct sockaddr_in *server = init_server_addr(cfg.port);
+    int listenfd = set_up_server_socket(server, cfg.backlog);
     
     // initialize allset and add listenfd to the
     // set of file descriptors passed into select
@@ -465,31 +300,72 @@ int main(int argc, char **argv) {
     FD_SET(listenfd, &allset);
     // maxfd identifies how far into the set to search
     maxfd = listenfd;
+    int timeouts = cfg.name_timeout_ms > 0 || cfg.idle_timeout_ms > 0;
+    long next_sweep = server_ms() + SWEEP_MS;
 
     while (1) {
         // make a copy of the set before we pass it into select
         rset = allset;
-        nready = select(maxfd + 1, &rset, NULL, NULL, NULL);
+        // Wake up in time to seat the player who has waited longest
+        struct timeval tv, *timeout = NULL;
+        long wait = lobby_timeout(&lobby, server_ms());
+        // and to look for connections that have timed out
+        if (timeouts && lobby.connected > 0) {
+            long sweep = next_sweep - server_ms();
+            sweep = (sweep > 0) ? sweep : 0;
+            wait = (wait < 0 || sweep < wait) ? sweep : wait;
+        }
+        if (wait >= 0) {
+            tv.tv_sec = wait / 1000;
+            tv.tv_usec = (wait % 1000) * 1000;
+            timeout = &tv;
+        }
+        nready = select(maxfd + 1, &rset, NULL, NULL, timeout);
+        if (report_wanted) {
+            report_wanted = 0;
+            lobby_report(&lobby, stdout);
+            fflush(stdout);
+        }
         if (nready == -1) {
-            perror("select");
+            if (errno != EINTR) {
+                perror("select");
+            }
             continue;
         }
 
+        long now = server_ms();
+
         if (FD_ISSET(listenfd, &rset)){
             printf("A new client is connecting\n");
-            clientfd = accept_connection(listenfd);
-
+            clientfd = accept_connection(listenfd, &q);
+        }
+        if (FD_ISSET(listenfd, &rset) && !ip_allow(q.sin_addr, now)) {
+            // Too many connections from this address; drop it before it
+            // costs anything more
+            printf("Refusing connection from %s\n", inet_ntoa(q.sin_addr));
+            close(clientfd);
+        } else if (FD_ISSET(listenfd, &rset) &&
+                (lobby.connected >= cfg.max_clients || clientfd >= MAX_CLIENTS)) {
+            printf("Refusing connection from %s: server is full\n", inet_ntoa(q.sin_addr));
+            close(clientfd);
+        } else if (FD_ISSET(listenfd, &rset)) {
+            if (fcntl(clientfd, F_SETFL, fcntl(clientfd, F_GETFL) | O_NONBLOCK) == -1) {
+                perror("fcntl");
+                exit(1);
+            }
             FD_SET(clientfd, &allset);
             if (clientfd > maxfd) {
                 maxfd = clientfd;
             }
             // printf("Connection from %s\n", inet_ntoa(q.sin_addr));
-            add_player(&new_players, clientfd, q.sin_addr);
-            char *greeting = WELCOME_MSG;
-            if(write(clientfd, greeting, strlen(greeting)) == -1) {
-                fprintf(stderr, "Write to client %s failed\n", inet_ntoa(q.sin_addr));
-                remove_player(&game, &new_players, clientfd);
-            };
+            struct game_event join = {EV_JOIN, clientfd, q.sin_addr};
+            run_event(&lobby, &join);
+            // Rate limits and timeouts are the server's business, not the game's
+            if ((p = lobby_client(&lobby, clientfd)) != NULL) {
+                bucket_init(&p->limit, CLIENT_BURST, join.ms);
+                p->joined_ms = join.ms;
+                p->last_ms = join.ms;
+            }
         }
         
         // To ignore SIGPIPE
@@ -504,124 +380,69 @@ int main(int argc, char **argv) {
         
         /* Check which other socket descriptors have something ready to read.
          * The reason we iterate over the rset descriptors at the top level and
-         * search through the two lists of clients each time is that it is
+         * look the client up by descriptor each time is that it is
          * possible that a client will be removed in the middle of one of the
-         * operations. This is also why we call break after handling the input.
-         * If a client has been removed the loop variables may not longer be 
-         * valid.
+         * operations. This is also why we look the client up again after each
+         * line. If a client has been removed the loop variables may not longer
+         * be valid.
          */
-        int cur_fd, exist, num_read, valid;
-        char win[MAX_MSG];
-        char guess[MAX_BUF];
-        char game_continue_msg[MAX_MSG];
-        win[0] = '\0';
-        guess[0] = '\0';
-        game_continue_msg[0] = '\0';
+        int cur_fd, start;
+        char *line;
         for(cur_fd = 0; cur_fd <= maxfd; cur_fd++) {
             if(FD_ISSET(cur_fd, &rset)) {
-                // Check if this socket descriptor is an active player
-                for(p = game.head; p != NULL; p = p->next) {
-                    if (cur_fd == p->fd) {
-                        // TODO - handle input from an active client
-                        valid = guess_word(&game, cur_fd, guess, p->name);
-                        exist = check_play(&(game.head), cur_fd);
-                        char *turn = malloc(MAX_MSG);
-                        if (turn < 0) {
-                            perror("malloc");
-                            exit(1);
-                        }
-                        if (exist && valid == 0) {
-                            num_read = strlen(guess) + 2;
-                            printf("[%d] Read %d bytes\n", cur_fd, num_read);
-                            printf("[%d] newline %s\n",cur_fd, guess);
-                            int correct = update(&game, guess);
-                            if (strcmp(game.guess, game.word) == 0) {
-                                strcat(win, "The word was ");
-                                strcat(win, game.word);
-                                strcat(win, "\r\n");
-                                broadcast(&game, win, "all");
-                                announce_winner(&game, p);
-                                init_game(&game, argv[1]);
-                                announce_turn(&game);
-                                printf("Game over. %s won!\n", p->name);
-                                printf("New game\n");
-                                printf("It's %s's turn.\n", (game.has_next_turn)->name);
-                            } else { 
-                                if (correct == 1) {
-                                    if (dprintf(cur_fd, "%c not in the word\n", guess[0]) < 0) {
-                                        remove_player(&game, &(game.head), cur_fd);
-                                    }
-                                    game.guesses_left -= 1;
-                                    advance_turn(&game);
-                                    printf("Letter %c is not in the word\n", guess[0]);
-                                }
-                                strcat(game_continue_msg, p->name);
-                                strcat(game_continue_msg, " guesses: ");
-                                strncat(game_continue_msg, guess, 1);
-                                strcat(game_continue_msg, "\r\n");
-                                broadcast(&game, game_continue_msg, "all");
-                                turn = status_message(turn, &game);
-                                broadcast(&game, turn, "all");
-                                announce_turn(&game);
-                                printf("It's %s's turn.\n", (game.has_next_turn)->name);
-                                free(turn);
-                                if (check_over(&game)) {
-                                    init_game(&game, argv[1]);
-                                    announce_turn(&game);
-                                    printf("It's %s's turn.\n", (game.has_next_turn)->name);
-                                }
-                            }
-                            break;
-                        } else { 
-                            break;
-                        }
-                    }
+                // Check if this socket descriptor belongs to a client
+                if ((p = lobby_client(&lobby, cur_fd)) == NULL) {
+                    continue;
                 }
-                // Check if new players are entering their names
-                for(p = new_players; p != NULL; p = p->next) {
-                    if(cur_fd == p->fd) {
-                        // TODO - handle input from an new client who has
-                        char username[MAX_NAME];
-                        username[0] = '\0';
-                        char *turn = malloc(MAX_MSG);
-                        if (turn < 0) {
-                            perror("malloc");
-                            exit(1);
-                        }
-                        valid = read_username(username, &game, cur_fd);
-                        exist = check_play(&(new_players), cur_fd);
-                        if (exist == 0) { 
-                            remove_player(&game, &new_players, cur_fd);
-                            break;
-                        } else if (exist && valid == 0) { 
-                            move_to_game(&new_players, cur_fd, &game, username);
-                            num_read = strlen(username) + 2;
-                            printf("[%d] Read %d bytes\n", cur_fd, num_read);
-                            printf("[%d] newline %s\n", cur_fd, username);
-                            char enter_game[MAX_MSG];
-                            enter_game[0] = '\0';
-                            strcat(enter_game, username);
-                            strcat(enter_game, " has joined.\r\n");
-                            broadcast(&game, enter_game, "all");
-                            printf("%s", enter_game);
-                            printf("It's %s's turn.\n", (game.has_next_turn)->name);
-                            turn = status_message(turn, &game);
-                            if (dprintf(cur_fd, "%s", turn) < 0) {
-                                remove_player(&game, &(game.head), cur_fd);
-                            }
-                            free(turn);
-                            announce_turn(&game);
-                            break;
-                        } else if (exist && valid == 1) { 
-                            if (dprintf(cur_fd, "\r\n")< 0) { 
-                                remove_player(&game, &new_players, cur_fd);
-                            }
+                int num_read = check_read(p);
+                if (num_read == 0) {
+                    drop_client(&lobby, cur_fd);
+                    continue;
+                } else if (num_read < 0) {
+                    continue;
+                }
+                p->last_ms = now;
+                start = 0;
+                while ((line = next_line(p, &start)) != NULL) {
+                    // Lines over budget are dropped without being parsed
+                    if (!allow_line(p, now)) {
+                        if (p->strikes >= ABUSE_STRIKES) {
+                            printf("Closing %d: too much input\n", cur_fd);
+                            drop_client(&lobby, cur_fd);
+                            p = NULL;
                             break;
                         }
+                        continue;
                     }
+                    struct game_event ev = {EV_LINE, cur_fd};
+                    ev.text = line;
+                    run_event(&lobby, &ev);
+                    // The client may have been removed
+                    if ((p = lobby_client(&lobby, cur_fd)) == NULL) {
+                        break;
+                    }
+                }
+                if (p == NULL) {
+                    continue;
+                }
+                drop_lines(p, start);
+                // A line too long for inbuf is over the input budget
+                if (p->in_ptr - p->inbuf >= p->in_size - 1) {
+                    printf("Closing %d: line too long\n", cur_fd);
+                    drop_client(&lobby, cur_fd);
                 }
             }
         }
+        if (timeouts && now >= next_sweep) {
+            drop_idle(&lobby, &cfg, maxfd, now);
+            next_sweep = now + SWEEP_MS;
+        }
+        // One merged update per tick instead of one per guess
+        struct game_event tick = {EV_TICK, 0};
+        run_event(&lobby, &tick);
+        if (journal != NULL) {
+            fflush(journal);
+        }
     }
     return 0;
-}
\ No newline at end of file
+}